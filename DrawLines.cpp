@@ -6,18 +6,43 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cstring>
+#include <deque>
+
 //All DrawLines instances share a vertex array object and vertex buffer, initialized at load time:
 
 //n.b. declared static so they don't conflict with similarly named global variables elsewhere:
 static GLuint vertex_buffer = 0;
 static GLuint vertex_buffer_for_color_program = 0;
 
+//vertex_buffer is used as a ring buffer:
+static GLsizeiptr ring_size = 1 << 20; //(a multiple of sizeof(DrawLines::Vertex); grown if needed)
+static GLintptr ring_head = 0; //where the next vertices are written
+//ranges of the ring the GPU may still be reading, oldest first, with fences that signal when it's done:
+struct InFlight {
+	GLsync fence;
+	GLintptr begin, end;
+};
+static std::deque< InFlight > in_flight;
+
+DrawLines::StreamStats DrawLines::stream_stats;
+DrawLines::StreamStats DrawLines::last_frame_stats;
+
+void DrawLines::begin_frame() {
+	last_frame_stats = stream_stats;
+	stream_stats = StreamStats();
+}
+
 static Load< void > setup_buffers(LoadTagDefault, [](){
 	//you may recognize this init code from DrawSprites.cpp:
 
 	{ //set up vertex buffer:
 		glGenBuffers(1, &vertex_buffer);
-		//for now, buffer will be un-filled.
+		//allocate storage for the ring (DrawLines fill it in as they go):
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+		glBufferData(GL_ARRAY_BUFFER, ring_size, nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		DrawLines::stream_stats.reallocations += 1;
 	}
 
 	{ //vertex array mapping buffer for color_program:
@@ -94,22 +119,14 @@ void DrawLines::draw_text(std::string const &text, glm::vec3 const &anchor_in, g
 
 	glm::vec3 anchor = anchor_in;
 
-	uint32_t start = 0;
-	while (start < text.size()) {
-		uint32_t end = start;
-		uint32_t glyph = -1U;
-		while (end < text.size()) {
-			end += 1;
-			auto f = PathFont::font.glyph_map.find(text.substr(start, end-start));
-			if (f == PathFont::font.glyph_map.end()) {
-				end -= 1;
-				break;
-			}
-			glyph = f->second;
-		}
+	const char *at = text.data();
+	const char *text_end = text.data() + text.size();
+	while (at < text_end) {
+		uint32_t length = 0;
+		uint32_t glyph = PathFont::font.match(at, text_end, &length);
 		if (glyph == -1U) {
-			assert(start == end);
-			end += 1;
+			assert(length == 0);
+			length = 1;
 			//missing! draw a tofu:
 			for (const auto &pt : {
 				glm::vec2(0.1f, 0.1f), glm::vec2(0.6f, 0.1f),
@@ -126,7 +143,7 @@ void DrawLines::draw_text(std::string const &text, glm::vec3 const &anchor_in, g
 			}
 			anchor += x * PathFont::font.glyph_widths[glyph];
 		}
-		start = end;
+		at += length;
 	}
 
 	if (anchor_out) *anchor_out = anchor;
@@ -137,10 +154,64 @@ DrawLines::~DrawLines() {
 
 	//based on DrawSprites.cpp :
 
-	//upload vertices to vertex_buffer:
+	//upload vertices to the next free space in vertex_buffer:
+	GLsizeiptr bytes = attribs.size() * sizeof(attribs[0]);
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
-	glBufferData(GL_ARRAY_BUFFER, attribs.size() * sizeof(attribs[0]), attribs.data(), GL_STREAM_DRAW); //upload attribs array
+
+	if (bytes > ring_size) {
+		//too big for the ring: re-allocate storage (the old storage stays around until the GPU is done with it):
+		while (ring_size < bytes) ring_size *= 2;
+		glBufferData(GL_ARRAY_BUFFER, ring_size, nullptr, GL_STREAM_DRAW);
+		stream_stats.reallocations += 1;
+		for (auto const &f : in_flight) {
+			glDeleteSync(f.fence);
+		}
+		in_flight.clear();
+		ring_head = 0;
+	}
+	//helper: wait until the GPU is done with the oldest range in flight, then forget it:
+	auto retire_oldest = [&]() {
+		GLsync fence = in_flight.front().fence;
+		stream_stats.syncs += 1;
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			stream_stats.stalls += 1;
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+				//(keep waiting)
+			}
+		}
+		glDeleteSync(fence);
+		in_flight.pop_front();
+	};
+
+	if (ring_head + bytes > ring_size) {
+		//wrap around; ranges from the previous lap past the old head are older than anything at the front of the ring,
+		// so retire them first (otherwise they would hide this lap's ranges from the overlap check below):
+		while (!in_flight.empty() && in_flight.front().begin >= ring_head) {
+			retire_oldest();
+		}
+		ring_head = 0;
+	}
+
+	//wait until the GPU is done with anything in the way:
+	// (ranges in flight are in ring order starting just past ring_head, so only the oldest ones can overlap)
+	while (!in_flight.empty() && in_flight.front().begin < ring_head + bytes && ring_head < in_flight.front().end) {
+		retire_oldest();
+	}
+
+	//(unsynchronized, since the fences above already made sure the GPU isn't using this range)
+	void *mapped = glMapBufferRange(GL_ARRAY_BUFFER, ring_head, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped) {
+		std::memcpy(mapped, attribs.data(), bytes);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	} else {
+		//(can't throw from a destructor; fall back to a plain upload)
+		glBufferSubData(GL_ARRAY_BUFFER, ring_head, bytes, attribs.data());
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	stream_stats.bytes_streamed += bytes;
+
+	GLintptr begin = ring_head;
+	ring_head += bytes;
 
 	//set color_program as current program:
 	glUseProgram(color_program->program);
@@ -152,7 +223,10 @@ DrawLines::~DrawLines() {
 	glBindVertexArray(vertex_buffer_for_color_program);
 
 	//run the OpenGL pipeline:
-	glDrawArrays(GL_LINES, 0, GLsizei(attribs.size()));
+	glDrawArrays(GL_LINES, GLint(begin / sizeof(Vertex)), GLsizei(attribs.size()));
+
+	//mark when the GPU is done with these vertices:
+	in_flight.emplace_back(InFlight{ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), begin, ring_head });
 
 	//reset vertex array to none:
 	glBindVertexArray(0);
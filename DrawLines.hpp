@@ -45,4 +45,18 @@ struct DrawLines {
 	};
 	std::vector< Vertex > attribs;
 
+	//All DrawLines share one ring buffer of vertices: each instance appends its vertices after the last one's
+	// (with an unsynchronized map), and fences mark when the GPU is done with them, so space is only waited on
+	// when the ring wraps around onto vertices that might still be in use.
+	//Counters for all DrawLines since the last begin_frame() ('stream_stats') and for the whole frame before that ('last_frame_stats'):
+	struct StreamStats {
+		size_t bytes_streamed = 0; //vertex bytes written into the ring buffer
+		uint32_t syncs = 0; //fences checked before re-using ring buffer space
+		uint32_t stalls = 0; //..of which weren't signaled yet, so the CPU had to wait
+		uint32_t reallocations = 0; //ring buffer storage (re)allocations (only when a single DrawLines doesn't fit)
+	};
+	static StreamStats stream_stats;
+	static StreamStats last_frame_stats;
+	//call once per frame, before drawing (the main loops do); moves stream_stats to last_frame_stats and resets it:
+	static void begin_frame();
 };
@@ -11,17 +11,11 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	//----- build the pipeline template -----
 	lit_color_texture_program_pipeline.program = ret->program;
 
-	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
-
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	//(matrices, camera, and light come from uniform blocks that Scene::draw fills)
+	lit_color_texture_program_pipeline.Object_block = ret->Object_block;
+
+	lit_color_texture_program_pipeline.INSTANCED_bool = ret->INSTANCED_bool;
+	lit_color_texture_program_pipeline.POSITION_TO_OBJECT_mat4x3 = ret->POSITION_TO_OBJECT_mat4x3;
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -30,6 +24,7 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	glBindTexture(GL_TEXTURE_2D, tex);
 	std::vector< glm::u8vec4 > tex_data(1, glm::u8vec4(0xff));
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, tex_data.data());
+	load_stats_upload(tex_data.size() * sizeof(tex_data[0]));
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -41,16 +36,32 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	lit_color_texture_program_pipeline.textures[0].target = GL_TEXTURE_2D;
 
 	return ret;
-});
+}, LoadInfo{ "lit_color_texture_program" });
+
+//per-frame camera and light grid size (shared by both shader stages; layout matches Scene::FrameUniforms):
+#define FRAME_BLOCK \
+	"layout(std140) uniform Frame {\n" \
+	"	mat4 WORLD_TO_CLIP;\n" \
+	"	mat4x3 WORLD_TO_LIGHT;\n" \
+	"	ivec2 LIGHT_TILES;\n" \
+	"};\n"
 
 LitColorTextureProgram::LitColorTextureProgram() {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
 		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		FRAME_BLOCK
+		//(layout matches Scene::ObjectUniforms)
+		"layout(std140) uniform Object {\n"
+		"	mat4 OBJECT_TO_CLIP;\n"
+		"	mat4x3 OBJECT_TO_LIGHT;\n"
+		"	mat3 NORMAL_TO_LIGHT;\n"
+		"};\n"
+		//when drawing instances, per-instance object-to-world matrices come from INSTANCES instead:
+		"uniform bool INSTANCED;\n"
+		"uniform samplerBuffer INSTANCES;\n"
+		"uniform mat4x3 POSITION_TO_OBJECT;\n" //(for quantized meshes)
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -59,48 +70,76 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
+		"out vec4 clipPosition;\n" //(used to find the light tile)
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	if (INSTANCED) {\n"
+		"		int base = 3 * gl_InstanceID;\n"
+		"		mat4 object_to_world = transpose(mat4(\n"
+		"			texelFetch(INSTANCES, base+0),\n"
+		"			texelFetch(INSTANCES, base+1),\n"
+		"			texelFetch(INSTANCES, base+2),\n"
+		"			vec4(0.0, 0.0, 0.0, 1.0)\n"
+		"		));\n"
+		"		mat4x3 object_to_light = WORLD_TO_LIGHT * object_to_world;\n"
+		"		vec4 object_position = vec4(POSITION_TO_OBJECT * Position, 1.0);\n"
+		"		gl_Position = (WORLD_TO_CLIP * object_to_world) * object_position;\n"
+		"		position = object_to_light * object_position;\n"
+		"		normal = inverse(transpose(mat3(object_to_light))) * Normal;\n"
+		"	} else {\n"
+		"		gl_Position = OBJECT_TO_CLIP * Position;\n"
+		"		position = OBJECT_TO_LIGHT * Position;\n"
+		"		normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	}\n"
+		"	clipPosition = gl_Position;\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
 	,
 		//fragment shader:
 		"#version 330\n"
+		FRAME_BLOCK
 		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
+		//lights and per-tile light lists (see Scene::LightGrid):
+		"uniform samplerBuffer LIGHTS;\n"
+		"uniform usamplerBuffer TILE_LIGHTS;\n"
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
 		"in vec4 color;\n"
 		"in vec2 texCoord;\n"
+		"in vec4 clipPosition;\n"
 		"out vec4 fragColor;\n"
 		"void main() {\n"
 		"	vec3 n = normalize(normal);\n"
-		"	vec3 e;\n"
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+		"	vec2 ndc = clipPosition.xy / clipPosition.w;\n"
+		"	ivec2 xy = clamp(ivec2(floor((ndc * 0.5 + 0.5) * vec2(LIGHT_TILES))), ivec2(0), LIGHT_TILES - 1);\n"
+		"	int tile = xy.y * LIGHT_TILES.x + xy.x;\n"
+		"	int begin = int(texelFetch(TILE_LIGHTS, tile).r);\n"
+		"	int end = int(texelFetch(TILE_LIGHTS, tile+1).r);\n"
+		"	vec3 e = vec3(0.0);\n"
+		"	for (int i = begin; i < end; ++i) {\n"
+		"		int light = 3 * int(texelFetch(TILE_LIGHTS, i).r);\n"
+		"		vec4 location = texelFetch(LIGHTS, light+0);\n" //(xyz, type)
+		"		vec4 direction = texelFetch(LIGHTS, light+1);\n" //(xyz, spot cutoff)
+		"		vec4 energy = texelFetch(LIGHTS, light+2);\n" //(rgb, range)
+		"		int type = int(location.w);\n"
+		"		if (type == 0 || type == 2) { //point or spot light \n"
+		"			vec3 l = (location.xyz - position);\n"
+		"			float dis2 = dot(l,l);\n"
+		"			l = normalize(l);\n"
+		"			float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"			float r = dis2 / max(energy.w * energy.w, 1e-6);\n"
+		"			float window = clamp(1.0 - r * r, 0.0, 1.0);\n" //(fade out by the range lights are culled at)
+		"			nl *= window * window;\n"
+		"			if (type == 2) {\n"
+		"				float c = dot(l,-direction.xyz);\n"
+		"				nl *= smoothstep(direction.w,mix(direction.w,1.0,0.1), c);\n"
+		"			}\n"
+		"			e += nl * energy.rgb;\n"
+		"		} else if (type == 1) { //hemi light \n"
+		"			e += (dot(n,-direction.xyz) * 0.5 + 0.5) * energy.rgb;\n"
+		"		} else { //(type == 3) //directional light \n"
+		"			e += max(0.0, dot(n,-direction.xyz)) * energy.rgb;\n"
+		"		}\n"
 		"	}\n"
 		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
 		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
@@ -108,6 +147,7 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	);
 	//As you can see above, adjacent strings in C/C++ are concatenated.
 	// this is very useful for writing long shader programs inline.
+	// (and FRAME_BLOCK, being a string literal, joins in as well)
 
 	//look up the locations of vertex attributes:
 	Position_vec4 = glGetAttribLocation(program, "Position");
@@ -115,24 +155,29 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
-	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	//look up the uniform blocks, and attach them to the binding points Scene::draw uses:
+	Frame_block = glGetUniformBlockIndex(program, "Frame");
+	Object_block = glGetUniformBlockIndex(program, "Object");
+	glUniformBlockBinding(program, Frame_block, Scene::Drawable::Pipeline::FrameBlockBinding);
+	glUniformBlockBinding(program, Object_block, Scene::Drawable::Pipeline::ObjectBlockBinding);
 
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
+	//look up the locations of uniforms:
+	INSTANCED_bool = glGetUniformLocation(program, "INSTANCED");
+	POSITION_TO_OBJECT_mat4x3 = glGetUniformLocation(program, "POSITION_TO_OBJECT");
 
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+	GLuint INSTANCES_samplerBuffer = glGetUniformLocation(program, "INSTANCES");
+	GLuint LIGHTS_samplerBuffer = glGetUniformLocation(program, "LIGHTS");
+	GLuint TILE_LIGHTS_usamplerBuffer = glGetUniformLocation(program, "TILE_LIGHTS");
 
 	//set TEX to always refer to texture binding zero:
 	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
 
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
+	glUniform1i(INSTANCES_samplerBuffer, Scene::Drawable::Pipeline::InstanceTextureUnit); //set INSTANCES to the unit Scene::draw uses for per-instance data
+	glUniform1i(LIGHTS_samplerBuffer, Scene::Drawable::Pipeline::LightTextureUnit); //set LIGHTS and TILE_LIGHTS to the units Scene::draw puts lights in
+	glUniform1i(TILE_LIGHTS_usamplerBuffer, Scene::Drawable::Pipeline::LightTileTextureUnit);
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
 }
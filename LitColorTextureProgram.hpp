@@ -17,20 +17,19 @@ struct LitColorTextureProgram {
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
 
-	//Uniform (per-invocation variable) locations:
-	GLuint OBJECT_TO_CLIP_mat4 = -1U;
-	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
-	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
-
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
+	//Uniform block indices (see Scene::FrameUniforms and Scene::ObjectUniforms):
+	GLuint Frame_block = -1U; //camera and light tiles; WORLD_TO_CLIP, WORLD_TO_LIGHT, LIGHT_TILES
+	GLuint Object_block = -1U; //OBJECT_TO_CLIP, OBJECT_TO_LIGHT, NORMAL_TO_LIGHT
+
+	//instancing (see Scene::Drawable::Pipeline):
+	GLuint INSTANCED_bool = -1U;
+	GLuint POSITION_TO_OBJECT_mat4x3 = -1U;
 	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
+	//TEXTURE4 - (when instancing) buffer texture of per-instance object-to-world matrices
+	//TEXTURE5 - buffer texture of lights (see Scene::LightGrid)
+	//TEXTURE6 - buffer texture of per-tile light lists
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
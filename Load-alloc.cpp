@@ -0,0 +1,46 @@
+#include "Load.hpp"
+
+#ifdef LOAD_TRACE_ALLOC
+
+#include <cstdlib>
+#include <new>
+
+//Replacement global allocation functions that count allocations made by load functions for LOAD_TRACE.
+// (only built with LOAD_TRACE_ALLOC -- see the Jamfile -- since every allocation in the program pays for the check)
+// (these live in their own file so that compilers don't see them paired with inlined library code)
+
+void *operator new(std::size_t size) {
+	if (load_counters) {
+		load_counters->allocated += size;
+		load_counters->allocations += 1;
+	}
+	if (size == 0) size = 1;
+	while (true) {
+		if (void *ptr = std::malloc(size)) return ptr;
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+}
+
+void *operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+#endif //LOAD_TRACE_ALLOC
@@ -1,20 +1,115 @@
 #include "Load.hpp"
 
-#include <array>
-#include <list>
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+thread_local LoadCounters *load_counters = nullptr;
+
+//are allocations counted? (Load-alloc.cpp only replaces the allocation functions in LOAD_TRACE_ALLOC builds)
+#ifdef LOAD_TRACE_ALLOC
+static constexpr bool counting_allocations = true;
+#else
+static constexpr bool counting_allocations = false;
+#endif
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
-		return load_lists;
+	bool tracing = false; //set during call_load_functions() if LOAD_TRACE is set
+
+	struct LoadStep {
+		LoadTag tag;
+		std::function< void() > fn;
+		bool has_info = false; //(without info, step waits for all earlier tags)
+		LoadInfo info;
+		void const *key = nullptr;
+
+		//used by call_load_functions():
+		std::vector< uint32_t > dependents;
+		uint32_t waiting = 0; //steps that must finish before this one starts
+		double start = 0.0, end = 0.0; //ms since call_load_functions() started
+		uint32_t ran_on = 0; //0 == GL thread, 1+ == worker
+		LoadCounters counters;
+	};
+
+	std::vector< LoadStep > &get_load_steps() {
+		static std::vector< LoadStep > load_steps;
+		return load_steps;
 	}
+
+	//work sent back to the GL thread by run_on_gl_thread():
+	struct GLTask {
+		std::function< void() > const *fn;
+		LoadCounters *counters; //(GL work is counted toward the step that asked for it)
+		bool done = false;
+		std::exception_ptr error;
+	};
+
+	//state shared between threads during call_load_functions():
+	struct Loading {
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque< uint32_t > ready_gl; //steps ready to run on GL thread
+		std::deque< uint32_t > ready_worker; //steps ready to run on workers
+		std::deque< GLTask * > gl_tasks;
+		uint32_t running = 0;
+		uint32_t finished = 0;
+		std::exception_ptr error; //first exception thrown by a step
+	};
+	Loading *loading = nullptr; //non-null during call_load_functions()
+	thread_local bool is_gl_thread = false;
+}
+
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key) {
+	assert(tag < MaxLoadTag);
+	LoadStep step;
+	step.tag = tag;
+	step.fn = fn;
+	step.key = key;
+	get_load_steps().emplace_back(std::move(step));
+}
+
+void add_load_function(LoadTag tag, std::function< void() > const &fn, LoadInfo const &info, void const *key) {
+	assert(tag < MaxLoadTag);
+	LoadStep step;
+	step.tag = tag;
+	step.fn = fn;
+	step.has_info = true;
+	step.info = info;
+	step.key = key;
+	get_load_steps().emplace_back(std::move(step));
+}
+
+void load_stats_read(size_t bytes) {
+	if (load_counters) load_counters->read += bytes;
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
-	auto &load_lists = get_load_lists();
-	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+void load_stats_upload(size_t bytes) {
+	if (load_counters) load_counters->uploaded += bytes;
+}
+
+void run_on_gl_thread(std::function< void() > const &fn) {
+	if (!loading || is_gl_thread) {
+		fn();
+		return;
+	}
+
+	GLTask task;
+	task.fn = &fn;
+	task.counters = load_counters;
+	std::unique_lock< std::mutex > lock(loading->mutex);
+	loading->gl_tasks.emplace_back(&task);
+	loading->cv.notify_all();
+	loading->cv.wait(lock, [&](){ return task.done; });
+	if (task.error) std::rethrow_exception(task.error);
 }
 
 void call_load_functions() {
@@ -22,11 +117,241 @@ void call_load_functions() {
 	assert(!has_been_called && "call_load_functions should only be called *once*");
 	has_been_called = true;
 
-	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	auto &steps = get_load_steps();
+
+	//name unnamed steps for the timeline:
+	static char const *tag_names[MaxLoadTag] = { "LoadTagEarly", "LoadTagDefault", "LoadTagLate" };
+	for (uint32_t i = 0; i < steps.size(); ++i) {
+		if (steps[i].info.name.empty()) {
+			steps[i].info.name = std::string("(") + tag_names[steps[i].tag] + " #" + std::to_string(i) + ")";
+		}
+	}
+
+	{ //build dependency graph:
+		std::unordered_map< void const *, uint32_t > by_key;
+		for (uint32_t i = 0; i < steps.size(); ++i) {
+			if (steps[i].key) by_key.emplace(steps[i].key, i);
+		}
+		auto depend = [&](uint32_t step, uint32_t on) {
+			steps[on].dependents.emplace_back(step);
+			steps[step].waiting += 1;
+		};
+		for (uint32_t i = 0; i < steps.size(); ++i) {
+			if (steps[i].has_info) {
+				for (void const *after : steps[i].info.after) {
+					auto f = by_key.find(after);
+					if (f == by_key.end()) {
+						throw std::runtime_error("Load '" + steps[i].info.name + "' depends on something that isn't being loaded.");
+					}
+					depend(i, f->second);
+				}
+			} else {
+				//steps without info keep the old behavior of waiting for all earlier tags:
+				for (uint32_t j = 0; j < steps.size(); ++j) {
+					if (steps[j].tag < steps[i].tag) depend(i, j);
+				}
+			}
+		}
+
+		//check for cycles (Kahn's algorithm):
+		std::vector< uint32_t > waiting(steps.size());
+		std::vector< uint32_t > todo;
+		for (uint32_t i = 0; i < steps.size(); ++i) {
+			waiting[i] = steps[i].waiting;
+			if (waiting[i] == 0) todo.emplace_back(i);
+		}
+		uint32_t visited = 0;
+		while (!todo.empty()) {
+			uint32_t i = todo.back();
+			todo.pop_back();
+			++visited;
+			for (uint32_t d : steps[i].dependents) {
+				if (--waiting[d] == 0) todo.emplace_back(d);
+			}
+		}
+		if (visited != steps.size()) {
+			throw std::runtime_error("Load functions have a dependency cycle.");
 		}
 	}
+
+	char const *trace_filename = std::getenv("LOAD_TRACE");
+	tracing = (trace_filename && trace_filename[0] != '\0');
+
+	Loading state;
+	auto start_time = std::chrono::steady_clock::now();
+	auto now_ms = [&]() {
+		return std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - start_time).count();
+	};
+
+	//(call with state.mutex held)
+	auto make_ready = [&](uint32_t i) {
+		if (steps[i].has_info && steps[i].info.thread == LoadOnWorker) state.ready_worker.emplace_back(i);
+		else state.ready_gl.emplace_back(i);
+	};
+
+	//run step 'i' (called with lock held, returns with lock held):
+	auto run_step = [&](std::unique_lock< std::mutex > &lock, uint32_t i, uint32_t thread) {
+		LoadStep &step = steps[i];
+		state.running += 1;
+		step.ran_on = thread;
+		step.start = now_ms();
+		lock.unlock();
+		if (tracing) load_counters = &step.counters;
+		std::exception_ptr error;
+		try {
+			step.fn();
+		} catch (...) {
+			error = std::current_exception();
+		}
+		load_counters = nullptr;
+		lock.lock();
+		step.end = now_ms();
+		state.running -= 1;
+		state.finished += 1;
+		if (error) {
+			if (!state.error) state.error = error;
+		} else {
+			for (uint32_t d : step.dependents) {
+				if (--steps[d].waiting == 0) make_ready(d);
+			}
+		}
+		state.cv.notify_all();
+	};
+
+	uint32_t worker_steps = 0;
+	for (uint32_t i = 0; i < steps.size(); ++i) {
+		if (steps[i].has_info && steps[i].info.thread == LoadOnWorker) ++worker_steps;
+		if (steps[i].waiting == 0) make_ready(i);
+	}
+
+	//workers run until every step has run (or loading has failed):
+	auto all_done = [&]() {
+		return state.finished == steps.size() || (state.error && state.running == 0);
+	};
+	std::vector< std::thread > workers;
+	//(at least two workers, since loading also spends time waiting on the disk)
+	uint32_t worker_count = std::min(worker_steps, std::max(2U, std::thread::hardware_concurrency()));
+	loading = &state;
+	is_gl_thread = true;
+	for (uint32_t w = 0; w < worker_count; ++w) {
+		workers.emplace_back([&,w](){
+			std::unique_lock< std::mutex > lock(state.mutex);
+			while (true) {
+				state.cv.wait(lock, [&](){ return all_done() || (!state.ready_worker.empty() && !state.error); });
+				if (all_done()) break;
+				uint32_t i = state.ready_worker.front();
+				state.ready_worker.pop_front();
+				run_step(lock, i, w + 1);
+			}
+		});
+	}
+
+	{ //GL thread runs GL steps and GL work sent from workers:
+		std::unique_lock< std::mutex > lock(state.mutex);
+		while (true) {
+			state.cv.wait(lock, [&](){ return all_done() || !state.gl_tasks.empty() || (!state.ready_gl.empty() && !state.error); });
+			if (!state.gl_tasks.empty()) {
+				GLTask *task = state.gl_tasks.front();
+				state.gl_tasks.pop_front();
+				lock.unlock();
+				load_counters = task->counters;
+				try {
+					(*task->fn)();
+				} catch (...) {
+					task->error = std::current_exception();
+				}
+				load_counters = nullptr;
+				lock.lock();
+				task->done = true;
+				state.cv.notify_all();
+			} else if (all_done()) {
+				break;
+			} else {
+				uint32_t i = state.ready_gl.front();
+				state.ready_gl.pop_front();
+				run_step(lock, i, 0);
+			}
+		}
+	}
+
+	for (auto &worker : workers) {
+		worker.join();
+	}
+	loading = nullptr;
+	tracing = false;
+
+	if (state.error) std::rethrow_exception(state.error);
+
+	{ //print timeline:
+		std::vector< uint32_t > order(steps.size());
+		for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return steps[a].start < steps[b].start;
+		});
+		double total = 0.0;
+		for (auto const &step : steps) total = std::max(total, step.end);
+
+		std::cout << "Loaded " << steps.size() << " things in " << std::fixed << std::setprecision(1) << total << " ms (" << worker_count << " workers):\n";
+		for (uint32_t i : order) {
+			LoadStep const &step = steps[i];
+			std::cout << "  " << std::setw(8) << step.start << " - " << std::setw(8) << step.end << " ms"
+				<< std::setw(9) << (step.end - step.start) << " ms  "
+				<< (step.ran_on == 0 ? std::string("gl      ") : "worker " + std::to_string(step.ran_on))
+				<< "  " << step.info.name << "\n";
+		}
+		std::cout << std::defaultfloat << std::setprecision(6);
+		std::cout.flush();
+	}
+
+	if (trace_filename && trace_filename[0] != '\0') { //write trace:
+		std::string filename = trace_filename;
+		std::ofstream out(filename, std::ios::binary);
+		auto quoted = [](std::string const &str, char escape) {
+			std::string ret = "\"";
+			for (char c : str) {
+				if (c == '"' || (c == '\\' && escape == '\\')) ret += escape;
+				if (uint8_t(c) < 0x20) ret += ' ';
+				else ret += c;
+			}
+			return ret + "\"";
+		};
+		if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".csv") {
+			//(allocation columns are left empty when allocations aren't counted)
+			out << "name,thread,start_ms,end_ms,bytes_read,bytes_allocated,allocations,gl_upload_bytes\n";
+			for (auto const &step : steps) {
+				out << quoted(step.info.name, '"') << ',' << (step.ran_on == 0 ? std::string("gl") : "worker " + std::to_string(step.ran_on))
+					<< ',' << step.start << ',' << step.end
+					<< ',' << step.counters.read;
+				if (counting_allocations) out << ',' << step.counters.allocated << ',' << step.counters.allocations;
+				else out << ",,";
+				out << ',' << step.counters.uploaded << '\n';
+			}
+		} else {
+			//Chrome trace event format; times are in microseconds:
+			out << "{\"traceEvents\":[\n";
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"gl\"}}";
+			for (uint32_t w = 0; w < worker_count; ++w) {
+				out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << (w + 1) << ",\"args\":{\"name\":\"worker " << (w + 1) << "\"}}";
+			}
+			out << std::fixed << std::setprecision(1);
+			for (auto const &step : steps) {
+				out << ",\n{\"name\":" << quoted(step.info.name, '\\') << ",\"cat\":\"load\",\"ph\":\"X\",\"pid\":1,\"tid\":" << step.ran_on
+					<< ",\"ts\":" << step.start * 1000.0 << ",\"dur\":" << (step.end - step.start) * 1000.0
+					<< ",\"args\":{\"bytes_read\":" << step.counters.read;
+				if (counting_allocations) {
+					out << ",\"bytes_allocated\":" << step.counters.allocated
+						<< ",\"allocations\":" << step.counters.allocations;
+				}
+				out << ",\"gl_upload_bytes\":" << step.counters.uploaded << "}}";
+			}
+			out << "\n]}\n";
+		}
+		if (!out) {
+			std::cerr << "WARNING: failed to write load trace to '" << filename << "'." << std::endl;
+		} else {
+			std::cout << "Wrote load trace to '" << filename << "'." << std::endl;
+		}
+	}
+
+	steps.clear();
 }
@@ -20,10 +20,31 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Alternatively, a load function can be given a LoadInfo, which names it, lists the Load<>s it depends on,
+ * and says whether it may run on a worker thread:
+ *
+ * Load< Scene > main_scene(LoadTagDefault, []() -> Scene const * {
+ *     return new Scene(...);
+ * }, LoadInfo{ "main.scene", LoadOnWorker, { &main_meshes } });
+ *
+ * Functions with a LoadInfo run as soon as everything in 'after' has loaded (tags don't order them).
+ * Worker functions must wrap any OpenGL calls in run_on_gl_thread().
+ * call_load_functions() prints a timeline showing when each function ran.
+ *
+ * Setting the LOAD_TRACE environment variable to a filename also records bytes read and
+ * uploaded to OpenGL by each load function, and writes them (with timings) to that file
+ * as a Chrome trace (chrome://tracing, ui.perfetto.dev) -- or as CSV if the name ends in ".csv".
+ * Bytes allocated are only recorded in builds made with LOAD_TRACE_ALLOC (see the Jamfile),
+ * since counting them means replacing the global allocation functions.
+ *
  */
 
 #include <functional>
 #include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
@@ -32,15 +53,51 @@ enum LoadTag : uint32_t {
 	MaxLoadTag //<-- just used to track # of load tags
 };
 
+enum LoadThread : uint32_t {
+	LoadOnGLThread, //run on the thread that calls call_load_functions() (which has the OpenGL context)
+	LoadOnWorker, //run on a worker thread
+};
+
+struct LoadInfo {
+	std::string name; //shown in the load timeline
+	LoadThread thread = LoadOnGLThread;
+	std::vector< void const * > after; //Load<>s (or other keys passed to add_load_function) that must be loaded first
+};
+
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+//Functions added without a LoadInfo run on the GL thread after every function in an earlier tag.
+//'key' is what other functions list in LoadInfo::after to depend on this one (Load<> uses its own address).
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key = nullptr);
+void add_load_function(LoadTag tag, std::function< void() > const &fn, LoadInfo const &info, void const *key = nullptr);
 
 //Call all loading functions:
 // (loading functions may throw exceptions if they fail.)
 // (only call *once*)
 void call_load_functions();
 
+//Record statistics for the currently-running load function's LOAD_TRACE report:
+// (these do nothing if LOAD_TRACE isn't set or when called outside of a load function)
+void load_stats_read(size_t bytes); //bytes read from files
+void load_stats_upload(size_t bytes); //bytes uploaded to OpenGL
+//(bytes allocated are counted automatically in LOAD_TRACE_ALLOC builds)
+
+//Run a function on the GL thread, waiting for it to finish:
+// (runs 'fn' immediately when called from the GL thread or outside of call_load_functions())
+// (exceptions thrown by 'fn' are passed back to the caller)
+void run_on_gl_thread(std::function< void() > const &fn);
+
+//-- internals --
+//statistics for LOAD_TRACE:
+struct LoadCounters {
+	uint64_t read = 0;
+	uint64_t allocated = 0; //(counted by the allocation functions in Load-alloc.cpp, when built with LOAD_TRACE_ALLOC)
+	uint64_t allocations = 0;
+	uint64_t uploaded = 0;
+};
+//counters for the load function running on this thread (only set when tracing):
+extern thread_local LoadCounters *load_counters;
+
 
 //work-around for MSVC not accepting this as a lambda:
 template< typename T >
@@ -55,7 +112,15 @@ struct Load {
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
-		});
+		}, this);
+	}
+	Load(LoadTag tag, const std::function< T const *() > &load_fn, LoadInfo const &info) : value(nullptr) {
+		add_load_function(tag, [this,load_fn,name=info.name](){
+			this->value = load_fn();
+			if (!(this->value)) {
+				throw std::runtime_error("Loading '" + name + "' failed.");
+			}
+		}, info, this);
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
@@ -74,7 +139,10 @@ template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
 	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+		add_load_function(tag, load_fn, this);
+	}
+	Load( LoadTag tag, const std::function< void() > &load_fn, LoadInfo const &info) {
+		add_load_function(tag, load_fn, info, this);
 	}
 };
 
@@ -1,64 +1,155 @@
 #include "Mesh.hpp"
 #include "read_write_chunk.hpp"
+#include "mapped_file.hpp"
+#include "Load.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
 #include <cstddef>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
 
 MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
+	//n.b. meshes may be loaded on a worker thread, so OpenGL calls go through run_on_gl_thread()
 
-	std::ifstream file(filename, std::ios::binary);
+	//chunks are viewed directly in the mapped file (vertex data is uploaded straight from it):
+	// (chunks are looked up by magic, so order doesn't matter and unknown chunks are skipped)
+	// (the file stays mapped, so the vertex and element chunks can be read again later; see 'vertices' in Mesh.hpp)
+	file = std::make_unique< MappedFile >(filename);
+	load_stats_read(file->size);
+	ChunkTable chunks(file->begin(), file->end());
 
-	GLuint total = 0;
+	GLuint total = 0; //number of vertices (for later checks on index)
 
-	struct Vertex {
-		glm::vec3 Position;
-		glm::vec3 Normal;
-		glm::u8vec4 Color;
-		glm::vec2 TexCoord;
-	};
-	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
+	bool quantized = false;
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+	//vertex data (uploaded once the index has been checked):
+	char const *vertex_data = nullptr;
+	size_t vertex_size = 0;
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		total = GLuint(data.size()); //store total for later checks on index
+	//read data chunk:
+	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
+		quantized = (chunks.find("pnq0") != nullptr);
+		if (quantized) {
+			chunks.read("pnq0", &packed_vertices);
+			vertex_data = reinterpret_cast< char const * >(packed_vertices.data());
+			total = GLuint(packed_vertices.size());
+			vertex_size = sizeof(PackedVertex);
+		} else {
+			chunks.read("pnct", &vertices);
+			vertex_data = reinterpret_cast< char const * >(vertices.data());
+			total = GLuint(vertices.size());
+			vertex_size = sizeof(Vertex);
+		}
 
 		//store attrib locations:
-		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+		if (quantized) {
+			Position = Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), offsetof(PackedVertex, Position));
+			Normal = Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), offsetof(PackedVertex, Normal));
+			Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex), offsetof(PackedVertex, Color));
+			TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), offsetof(PackedVertex, TexCoord));
+		} else {
+			Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
+			Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
+			Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+			TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+		}
 	} else {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	//quantized meshes list their bounding boxes in "qnt0" (parallel to the index entries):
+	struct Bounds {
+		glm::vec3 min, max;
+	};
+	static_assert(sizeof(Bounds) == 6*4, "Bounds is packed.");
+	ChunkSpan< Bounds > bounds;
+	if (quantized) {
+		chunks.read("qnt0", &bounds);
+	}
+
+	//set a mesh's bounding box (and, if quantized, how to get its positions to object space):
+	auto set_bounds = [&](Mesh &mesh, size_t i, uint32_t first_vertex, uint32_t last_vertex) {
+		if (quantized) {
+			if (i >= bounds.size()) {
+				throw std::runtime_error("index entry has no quantization bounds");
+			}
+			mesh.min = bounds[i].min;
+			mesh.max = bounds[i].max;
+			glm::vec3 size = glm::max(mesh.max - mesh.min, glm::vec3(0.0f));
+			mesh.position_to_object = glm::mat4x3(
+				glm::vec3(size.x, 0.0f, 0.0f),
+				glm::vec3(0.0f, size.y, 0.0f),
+				glm::vec3(0.0f, 0.0f, size.z),
+				mesh.min
+			);
+		} else {
+			for (uint32_t v = first_vertex; v < last_vertex; ++v) {
+				mesh.min = glm::min(mesh.min, vertices[v].Position);
+				mesh.max = glm::max(mesh.max, vertices[v].Position);
+			}
+		}
+	};
+
+	ChunkSpan< char > strings;
+	chunks.read("str0", &strings);
+
+	//indexed meshes (as written by optimize-meshes) are listed in "idx1" and index into "elm0":
+	if (chunks.find("idx1")) {
+		chunks.read("elm0", &elements);
 
-	{ //read index chunk, add to meshes:
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+			uint32_t element_begin, element_end;
+		};
+		static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
+
+		ChunkSpan< IndexEntry > index;
+		chunks.read("idx1", &index);
+
+		for (auto const &entry : index) {
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			if (!(entry.element_begin <= entry.element_end && entry.element_end <= elements.size())) {
+				throw std::runtime_error("index entry has out-of-range element start/count");
+			}
+			for (uint32_t e = entry.element_begin; e < entry.element_end; ++e) {
+				if (!(entry.vertex_begin <= elements[e] && elements[e] < entry.vertex_end)) {
+					throw std::runtime_error("index entry has element outside of its vertex range");
+				}
+			}
+			std::string name(strings.data() + entry.name_begin, strings.data() + entry.name_end);
+			Mesh mesh;
+			mesh.type = GL_TRIANGLES;
+			mesh.start = entry.element_begin;
+			mesh.count = entry.element_end - entry.element_begin;
+			mesh.index_type = GL_UNSIGNED_INT;
+			set_bounds(mesh, &entry - index.begin(), entry.vertex_begin, entry.vertex_end);
+			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
+			if (!inserted) {
+				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			}
+		}
+	} else { //read index chunk, add to meshes:
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
 			uint32_t vertex_begin, vertex_end;
 		};
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		ChunkSpan< IndexEntry > index;
+		chunks.read("idx0", &index);
 
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
@@ -67,15 +158,12 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			std::string name(strings.data() + entry.name_begin, strings.data() + entry.name_end);
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
-			}
+			set_bounds(mesh, &entry - index.begin(), entry.vertex_begin, entry.vertex_end);
 			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
 			if (!inserted) {
 				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
@@ -83,8 +171,38 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		}
 	}
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
+	//copy data into the geometry arena:
+	run_on_gl_thread([&](){
+		geometry_arena.allocate(this, total, GLuint(elements.size()));
+	});
+	//(indices in the file count from the file's first vertex, so need to be offset to count from the block's)
+	std::vector< uint32_t > offset_elements;
+	if (vertex_begin != 0 && elements.size() != 0) {
+		offset_elements.reserve(elements.size());
+		for (uint32_t e : elements) {
+			offset_elements.emplace_back(e + vertex_begin);
+		}
+	}
+	run_on_gl_thread([&](){
+		//(elements are uploaded through GL_ARRAY_BUFFER since the element array binding belongs to vertex array objects)
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, vertex_begin * vertex_size, total * vertex_size, vertex_data);
+		if (elements.size() != 0) {
+			glBindBuffer(GL_ARRAY_BUFFER, index_buffer);
+			glBufferSubData(GL_ARRAY_BUFFER, element_begin * sizeof(uint32_t), elements.size() * sizeof(uint32_t),
+				offset_elements.empty() ? elements.data() : offset_elements.data());
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		load_stats_upload(total * vertex_size + elements.size() * sizeof(uint32_t));
+	});
+	for (auto &[name, mesh] : meshes) {
+		mesh.start += (mesh.index_type == GL_NONE ? vertex_begin : element_begin);
+	}
+
+	//hash meshes by name for lookup():
+	index.reserve(meshes.size());
+	for (auto const &[name, mesh] : meshes) {
+		index.emplace(name, &mesh);
 	}
 
 	/* //DEBUG:
@@ -98,53 +216,277 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 	*/
 }
 
+MeshBuffer::~MeshBuffer() {
+	run_on_gl_thread([&](){
+		geometry_arena.free(this);
+	});
+}
+
 const Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
+	auto f = index.find(name);
+	if (f == index.end()) {
 		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
 	}
-	return f->second;
+	return *f->second;
+}
+
+std::pair< std::map< std::string, Mesh >::const_iterator, std::map< std::string, Mesh >::const_iterator >
+MeshBuffer::lookup_prefix(std::string const &prefix) const {
+	auto begin = meshes.lower_bound(prefix);
+	auto end = begin;
+	while (end != meshes.end() && end->first.compare(0, prefix.size(), prefix) == 0) {
+		++end;
+	}
+	return std::make_pair(begin, end);
 }
 
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
-	//create a new vertex array object:
 	GLuint vao = 0;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-
-	//Try to bind all attributes in this buffer:
-	std::set< GLuint > bound;
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib) {
-		if (attrib.size == 0) return; //don't bind empty attribs
-		GLint location = glGetAttribLocation(program, name);
-		if (location == -1) return; //can't bind missing attribs
-		glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
-		glEnableVertexAttribArray(location);
-		bound.insert(location);
+	//(may be called from a loading thread; GL calls -- and cache updates -- need to happen on the GL thread)
+	run_on_gl_thread([&](){
+		//already made (and checked) a vertex array object for this program?
+		auto f = block->vaos_by_program.find(program);
+		if (f != block->vaos_by_program.end()) {
+			vao = f->second;
+			return;
+		}
+
+		//find where the program wants each of the attributes in this buffer:
+		char const *names[4] = { "Position", "Normal", "Color", "TexCoord" };
+		Attrib const *attribs[4] = { &Position, &Normal, &Color, &TexCoord };
+		std::array< GLint, 4 > layout;
+		std::set< GLuint > bound;
+		for (uint32_t a = 0; a < 4; ++a) {
+			layout[a] = -1;
+			if (attribs[a]->size == 0) continue; //don't bind empty attribs
+			layout[a] = glGetAttribLocation(program, names[a]);
+			if (layout[a] != -1) bound.insert(GLuint(layout[a]));
+		}
+
+		//Check that all active attributes will be bound:
+		GLint active = 0;
+		glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
+		assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
+		for (GLuint i = 0; i < GLuint(active); ++i) {
+			GLchar name[100];
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
+			name[99] = '\0';
+			//(some drivers list built-ins like gl_InstanceID, which have no location and need no binding)
+			if (std::strncmp(name, "gl_", 3) == 0) continue;
+			GLint location = glGetAttribLocation(program, name);
+			if (location == -1) continue;
+			if (!bound.count(GLuint(location))) {
+				throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
+			}
+		}
+
+		//programs with the same layout share a vertex array object:
+		GLuint &shared = block->vaos_by_layout[layout];
+		if (shared == 0) {
+			//create a new vertex array object:
+			glGenVertexArrays(1, &shared);
+			glBindVertexArray(shared);
+
+			//bind all attributes the program uses:
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			for (uint32_t a = 0; a < 4; ++a) {
+				if (layout[a] == -1) continue;
+				Attrib const &attrib = *attribs[a];
+				glVertexAttribPointer(layout[a], attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
+				glEnableVertexAttribArray(layout[a]);
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			if (block->element_buffer != 0) {
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block->element_buffer); //(stays bound as part of the vertex array object)
+			}
+			glBindVertexArray(0);
+		}
+
+		vao = shared;
+		block->vaos_by_program.emplace(program, vao);
+	});
+
+	return vao;
+}
+
+//-------------------------
+
+GeometryArena geometry_arena;
+
+//first-fit allocation of 'count' items from a free list (returns -1U if no free range is big enough):
+static uint32_t allocate_range(std::map< uint32_t, uint32_t > &free, uint32_t count) {
+	if (count == 0) return 0;
+	for (auto f = free.begin(); f != free.end(); ++f) {
+		if (f->second - f->first < count) continue;
+		uint32_t begin = f->first;
+		uint32_t end = f->second;
+		free.erase(f);
+		if (begin + count < end) free.emplace(begin + count, end);
+		return begin;
+	}
+	return -1U;
+}
+
+//return [begin,end) to a free list, merging it with neighboring free ranges:
+static void free_range(std::map< uint32_t, uint32_t > &free, uint32_t begin, uint32_t end) {
+	if (begin == end) return;
+	auto next = free.lower_bound(begin);
+	if (next != free.end() && next->first == end) {
+		end = next->second;
+		next = free.erase(next);
+	}
+	if (next != free.begin()) {
+		auto prev = std::prev(next);
+		if (prev->second == begin) {
+			prev->second = end;
+			return;
+		}
+	}
+	free.emplace_hint(next, begin, end);
+}
+
+//resize a buffer from 'old_size' to 'new_size' bytes, keeping its contents -- and its name, so that
+// vertex array objects and MeshBuffers referring to it stay valid (makes the buffer if it is 0):
+static void grow_buffer(GLuint *buffer, size_t old_size, size_t new_size) {
+	if (*buffer == 0) {
+		glGenBuffers(1, buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, *buffer);
+		glBufferData(GL_ARRAY_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return;
+	}
+	//copy contents aside, reallocate, and copy them back:
+	GLuint scratch = 0;
+	glGenBuffers(1, &scratch);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+	glBufferData(GL_COPY_WRITE_BUFFER, old_size, nullptr, GL_STREAM_COPY);
+	glBindBuffer(GL_COPY_READ_BUFFER, *buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+	glBufferData(GL_COPY_READ_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+	glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, 0, old_size);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &scratch);
+}
+
+//capacity needed to allocate 'count' more items at the end of a free list (using its last range if that reaches 'capacity'):
+static uint32_t capacity_for(std::map< uint32_t, uint32_t > const &free, uint32_t capacity, uint32_t count) {
+	uint32_t begin = capacity;
+	if (!free.empty() && free.rbegin()->second == capacity) begin = free.rbegin()->first;
+	return begin + count;
+}
+
+void GeometryArena::allocate(MeshBuffer *buffer, uint32_t vertex_count, uint32_t element_count) {
+	assert(buffer && buffer->block == nullptr);
+
+	auto same_format = [&](GeometryBlock const &block) {
+		return block.Position == buffer->Position && block.Normal == buffer->Normal
+		    && block.Color == buffer->Color && block.TexCoord == buffer->TexCoord;
 	};
-	bind_attribute("Position", Position);
-	bind_attribute("Normal", Normal);
-	bind_attribute("Color", Color);
-	bind_attribute("TexCoord", TexCoord);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-
-	//Check that all active attributes were bound:
-	GLint active = 0;
-	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
-	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
-	for (GLuint i = 0; i < GLuint(active); ++i) {
-		GLchar name[100];
-		GLint size = 0;
-		GLenum type = 0;
-		glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
-		name[99] = '\0';
-		GLint location = glGetAttribLocation(program, name);
-		if (!bound.count(GLuint(location))) {
-			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
+
+	//try to fit the buffer's data into a block:
+	auto try_block = [&](GeometryBlock &block) {
+		if (!same_format(block)) return false;
+		uint32_t vertex_begin = allocate_range(block.free_vertices, vertex_count);
+		if (vertex_begin == -1U) return false;
+		uint32_t element_begin = allocate_range(block.free_elements, element_count);
+		if (element_begin == -1U) {
+			free_range(block.free_vertices, vertex_begin, vertex_begin + vertex_count);
+			return false;
+		}
+		buffer->block = &block;
+		buffer->buffer = block.vertex_buffer;
+		buffer->index_buffer = block.element_buffer;
+		buffer->vertex_begin = vertex_begin;
+		buffer->vertex_end = vertex_begin + vertex_count;
+		buffer->element_begin = element_begin;
+		buffer->element_end = element_begin + element_count;
+		return true;
+	};
+
+	//grow a block (to at most MaxBlockBytes / MaxBlockElements) so that it has room for the data:
+	auto try_grow = [&](GeometryBlock &block) {
+		if (!same_format(block)) return false;
+		uint32_t max_vertices = std::max(uint32_t(MaxBlockBytes / block.stride), block.vertex_capacity);
+		uint32_t max_elements = std::max(MaxBlockElements, block.element_capacity);
+
+		uint32_t vertex_capacity = block.vertex_capacity;
+		uint32_t needed_vertices = capacity_for(block.free_vertices, block.vertex_capacity, vertex_count);
+		if (vertex_count > 0 && needed_vertices > vertex_capacity) {
+			if (needed_vertices > max_vertices) return false;
+			vertex_capacity = std::max(needed_vertices, std::min(2 * block.vertex_capacity, max_vertices));
+		}
+		uint32_t element_capacity = block.element_capacity;
+		uint32_t needed_elements = capacity_for(block.free_elements, block.element_capacity, element_count);
+		if (element_count > 0 && needed_elements > element_capacity) {
+			if (needed_elements > max_elements) return false;
+			element_capacity = std::max(needed_elements, std::min(std::max(2 * block.element_capacity, MinBlockElements), max_elements));
+		}
+
+		if (vertex_capacity != block.vertex_capacity) {
+			grow_buffer(&block.vertex_buffer, size_t(block.vertex_capacity) * block.stride, size_t(vertex_capacity) * block.stride);
+			free_range(block.free_vertices, block.vertex_capacity, vertex_capacity);
+			block.vertex_capacity = vertex_capacity;
 		}
+		if (element_capacity != block.element_capacity) {
+			bool made = (block.element_buffer == 0);
+			grow_buffer(&block.element_buffer, size_t(block.element_capacity) * sizeof(uint32_t), size_t(element_capacity) * sizeof(uint32_t));
+			free_range(block.free_elements, block.element_capacity, element_capacity);
+			block.element_capacity = element_capacity;
+			if (made) {
+				//vertex array objects made before the block had indices need the new element buffer:
+				for (auto const &[layout, vao] : block.vaos_by_layout) {
+					glBindVertexArray(vao);
+					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.element_buffer);
+				}
+				glBindVertexArray(0);
+			}
+		}
+		return try_block(block);
+	};
+
+	for (auto &block : blocks) {
+		if (try_block(block)) return;
+	}
+	for (auto &block : blocks) {
+		if (try_grow(block)) return;
 	}
 
-	return vao;
+	//no block could make room, so make a new one:
+	blocks.emplace_back();
+	GeometryBlock &block = blocks.back();
+	block.Position = buffer->Position;
+	block.Normal = buffer->Normal;
+	block.Color = buffer->Color;
+	block.TexCoord = buffer->TexCoord;
+	block.stride = std::max(buffer->Position.stride, GLsizei(1));
+
+	block.vertex_capacity = std::max(vertex_count, uint32_t(MinBlockBytes / block.stride));
+	//(blocks only get indices once an indexed buffer needs them)
+	if (element_count > 0) {
+		block.element_capacity = std::max(element_count, MinBlockElements);
+	}
+	block.free_vertices.emplace(0, block.vertex_capacity);
+	if (block.element_capacity > 0) block.free_elements.emplace(0, block.element_capacity);
+
+	grow_buffer(&block.vertex_buffer, 0, size_t(block.vertex_capacity) * block.stride);
+	if (block.element_capacity > 0) {
+		grow_buffer(&block.element_buffer, 0, size_t(block.element_capacity) * sizeof(uint32_t));
+	}
+
+	bool fit = try_block(block);
+	assert(fit && "new block should be big enough");
+	(void)fit;
+}
+
+void GeometryArena::free(MeshBuffer *buffer) {
+	assert(buffer);
+	if (!buffer->block) return;
+	free_range(buffer->block->free_vertices, buffer->vertex_begin, buffer->vertex_end);
+	free_range(buffer->block->free_elements, buffer->element_begin, buffer->element_end);
+	buffer->block = nullptr;
+	buffer->buffer = 0;
+	buffer->index_buffer = 0;
 }
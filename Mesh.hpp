@@ -1,27 +1,40 @@
 #pragma once
 
 /*
- * In this code, "Mesh" is a range of vertices that should be sent through
- *  the OpenGL pipeline together.
- * A "MeshBuffer" holds a collection of such meshes (loaded from a file) in
- *  a single OpenGL array buffer. Individual meshes can be looked up by name
- *  using the MeshBuffer::lookup() function.
+ * In this code, "Mesh" is a range of vertices (or of indices into the vertices)
+ *  that should be sent through the OpenGL pipeline together.
+ * A "MeshBuffer" holds a collection of such meshes (loaded from a file).
+ *  Individual meshes can be looked up by name using the MeshBuffer::lookup() function.
+ * The vertices (and indices) of all MeshBuffers are stored in a few large
+ *  OpenGL buffers managed by the "GeometryArena", so meshes from different
+ *  files can be drawn without switching buffers or vertex array objects.
  *
  */
 
 #include "GL.hpp"
+#include "read_write_chunk.hpp"
 #include <glm/glm.hpp>
+#include <array>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <limits>
+#include <list>
 #include <string>
 
 
 struct Mesh {
 	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
+	// (or, for indexed meshes, ranges of the MeshBuffer's index_buffer)
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (or first index, for indexed meshes) in its arena block's buffers
+	GLuint count = 0; //count of vertices (or of indices, for indexed meshes)
+	GLenum index_type = GL_NONE; //GL_UNSIGNED_INT for indexed meshes (drawn with glDrawElements)
+
+	//Quantized meshes store positions as fractions of their bounding box;
+	// this matrix takes stored positions to object space (and is the identity for unquantized meshes):
+	glm::mat4x3 position_to_object = glm::mat4x3(1.0f);
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
@@ -29,26 +42,74 @@ struct Mesh {
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
 };
 
+struct GeometryBlock;
+struct MappedFile;
+
 struct MeshBuffer {
 	//construct from a file:
 	// note: will throw if file fails to read.
 	MeshBuffer(std::string const &filename);
+	//returns its vertices (and indices) to the geometry arena:
+	~MeshBuffer();
+
+	//a MeshBuffer owns its ranges of the arena, so copying is not advised:
+	MeshBuffer(MeshBuffer const &) = delete;
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
 	const Mesh &lookup(std::string const &name) const;
+
+	//look up all meshes whose names start with 'prefix' (as a range of 'meshes', which is sorted by name):
+	std::pair< std::map< std::string, Mesh >::const_iterator, std::map< std::string, Mesh >::const_iterator >
+	lookup_prefix(std::string const &prefix) const;
 	
-	//build a vertex array object that links this vbo to attributes to a program:
+	//get a vertex array object that links this vbo to attributes to a program:
+	// (vertex array objects are cached and owned by the arena block holding this buffer's data; asking again
+	//  for the same program -- from this or any other MeshBuffer in the same block -- returns the same one,
+	//  as does asking for any program that wants the block's attributes at the same locations)
 	// note: will throw if program defines attributes not contained in this buffer
+	// note: program names are assumed not to be reused
 	GLuint make_vao_for_program(GLuint program) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
+	// (either 36-byte float vertices, from a "pnct" chunk, or 20-byte quantized vertices, from a "pnq0" chunk;
+	//  the Attrib members below describe whichever was loaded)
+	// n.b. the buffer belongs to the geometry arena and is shared with other MeshBuffers
 	GLuint buffer = 0;
+	//...and the buffer of (32-bit) indices used by indexed meshes (also shared):
+	// (make_vao_for_program binds it as the vertex array's element array buffer)
+	GLuint index_buffer = 0;
+
+	//vertex formats:
+	// "pnct" chunks:
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+	// "pnq0" chunks (quantized vertices, as written by 'optimize-meshes --quantize'):
+	struct PackedVertex {
+		glm::u16vec4 Position; //xyz as 16-bit unorm fractions of the mesh's bounding box (w unused)
+		uint32_t Normal; //xyz as 10-bit snorm (GL_INT_2_10_10_10_REV)
+		glm::u8vec4 Color;
+		glm::u16vec2 TexCoord; //half floats
+	};
+	static_assert(sizeof(PackedVertex) == 4*2+4+4*1+2*2, "PackedVertex is packed.");
+
+	//The loaded data, on the CPU side (viewed in place in the file, which stays mapped, or copied if the file's
+	// chunks were compressed); used to read mesh data without going back to OpenGL (e.g., by Scene::build_static_batches):
+	std::unique_ptr< MappedFile > file;
+	ChunkSpan< Vertex > vertices; //(empty if quantized)
+	ChunkSpan< PackedVertex > packed_vertices; //(empty unless quantized)
+	ChunkSpan< uint32_t > elements; //n.b. these count from the file's first vertex, not from vertex_begin
 
 	//-- internals ---
 
-	//used by the lookup() function:
+	//used by the lookup() functions:
 	std::map< std::string, Mesh > meshes;
+	std::unordered_map< std::string, Mesh const * > index; //(hashed index into 'meshes')
 
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
@@ -61,10 +122,68 @@ struct MeshBuffer {
 		Attrib() = default;
 		Attrib(GLint size_, GLenum type_, GLboolean normalized_, GLsizei stride_, GLsizei offset_)
 		: size(size_), type(type_), normalized(normalized_), stride(stride_), offset(offset_) { }
+
+		bool operator==(Attrib const &o) const {
+			return size == o.size && type == o.type && normalized == o.normalized && stride == o.stride && offset == o.offset;
+		}
 	};
 
 	Attrib Position;
 	Attrib Normal;
 	Attrib Color;
 	Attrib TexCoord;
+
+	//where this buffer's data lives in the geometry arena:
+	GeometryBlock *block = nullptr;
+	uint32_t vertex_begin = 0, vertex_end = 0; //range of block's vertices
+	uint32_t element_begin = 0, element_end = 0; //range of block's elements
 };
+
+//The geometry arena sub-allocates ranges of a few large OpenGL buffers for all MeshBuffers:
+// - vertices with the same format (i.e., MeshBuffer::Attrib layout) are stored in the same "block"
+// - each block has one array buffer (for vertices) and, once an indexed MeshBuffer needs it,
+//   one element array buffer (for 32-bit indices)
+// - freed ranges go on per-block free lists, which allocations are made from (first fit)
+// n.b. the arena is only used on the GL thread (MeshBuffer wraps calls in run_on_gl_thread)
+struct GeometryBlock {
+	//vertex format:
+	MeshBuffer::Attrib Position, Normal, Color, TexCoord;
+	GLsizei stride = 0;
+
+	GLuint vertex_buffer = 0;
+	uint32_t vertex_capacity = 0; //in vertices
+	GLuint element_buffer = 0;
+	uint32_t element_capacity = 0; //in elements
+
+	//free ranges, as begin -> end:
+	std::map< uint32_t, uint32_t > free_vertices;
+	std::map< uint32_t, uint32_t > free_elements;
+
+	//used by MeshBuffer::make_vao_for_program():
+	//programs that have been checked, and the vertex array objects they use:
+	std::unordered_map< GLuint, GLuint > vaos_by_program;
+	//vertex array objects by attribute layout (locations of Position, Normal, Color, TexCoord; -1 if not bound):
+	std::map< std::array< GLint, 4 >, GLuint > vaos_by_layout;
+};
+
+struct GeometryArena {
+	//blocks start with room for at least this much data, so most formats only ever need one block:
+	static constexpr size_t MinBlockBytes = 4 << 20; //vertex data
+	static constexpr uint32_t MinBlockElements = 1 << 18; //32-bit indices
+	//when a block runs out of room it grows in place (doubling, and keeping its buffer names, so vertex
+	// array objects and MeshBuffers that refer to it stay valid) up to this size; after that, a new block is made:
+	// (allocations larger than this get a block of their own)
+	static constexpr size_t MaxBlockBytes = 64 << 20; //vertex data
+	static constexpr uint32_t MaxBlockElements = 1 << 22; //32-bit indices
+
+	std::list< GeometryBlock > blocks;
+
+	//find (or make) a block with the same vertex format as 'buffer', and allocate
+	// 'vertex_count' vertices and 'element_count' elements from it (setting the buffer's block and ranges):
+	void allocate(MeshBuffer *buffer, uint32_t vertex_count, uint32_t element_count);
+	//return a buffer's ranges to its block:
+	void free(MeshBuffer *buffer);
+};
+
+//the arena used by all MeshBuffers:
+extern GeometryArena geometry_arena;
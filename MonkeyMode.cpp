@@ -21,14 +21,14 @@
 
 #include <random>
 
-GLuint playground_meshes_for_lit_color_texture_program = 0;
 Load< MeshBuffer > playground_meshes(LoadTagDefault, []() -> MeshBuffer const * {
 	MeshBuffer const *ret = new MeshBuffer(data_path("playground.pnct"));
-	playground_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+	ret->make_vao_for_program(lit_color_texture_program->program); //(make -- and check -- vertex array object while loading)
 	return ret;
-});
+}, LoadInfo{ "playground.pnct", LoadOnWorker, { &lit_color_texture_program } });
 
 Load< Scene > playground_scene(LoadTagDefault, []() -> Scene const * {
+	GLuint vao = playground_meshes->make_vao_for_program(lit_color_texture_program->program); //(cached in the MeshBuffer)
 	return new Scene(data_path("playground.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = playground_meshes->lookup(mesh_name);
 
@@ -37,42 +37,40 @@ Load< Scene > playground_scene(LoadTagDefault, []() -> Scene const * {
 
 		drawable.pipeline = lit_color_texture_program_pipeline;
 
-		drawable.pipeline.vao = playground_meshes_for_lit_color_texture_program;
+		drawable.pipeline.vao = vao;
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.position_to_object = mesh.position_to_object;
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
 
 	});
-});
+}, LoadInfo{ "playground.scene", LoadOnWorker, { &playground_meshes } });
 
 Load< Sound::Sample > dusty_floor_sample(LoadTagDefault, []() -> Sound::Sample const * {
 	return new Sound::Sample(data_path("dusty-floor.opus"));			//TODO: change music
-});
+}, LoadInfo{ "dusty-floor.opus", LoadOnWorker });
 
 MonkeyMode::MonkeyMode() : scene(*playground_scene) {
-	//get pointers to leg for convenience:
-	for (auto &transform : scene.transforms) {
-		
-		if(transform.name == "Player") player = &transform;
-		
-		if(transform.name.find("Cube") != std::string::npos) {
-			cubes.push_back(&transform);
-		}
-		
+	//get pointers to player and cubes for convenience:
+	player = scene.find_transform("Player");
+	for (Scene::Transform *cube : scene.find_transforms("Cube")) {
+		cubes.push_back(cube);
 	}
 	
 	if (player == nullptr) throw std::runtime_error("Player not found.");
 	
 	player_base_rotation = player->rotation;
 
+	//(every drawable in playground.scene is the player or a cube, and all of them move, so nothing is marked is_static)
+
 	//get pointer to camera for convenience:
 	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
 	camera = &scene.cameras.front();
 
-	//get pointer to light, only 1 light source
-	//TODO: add more light source
-	if (scene.lights.size() != 1) throw std::runtime_error("Expecting scene to have exactly one light, but it has " + std::to_string(scene.lights.size()));
-	light = &scene.lights.front();
+	//(the scene may have any number of lights; Scene::draw sorts them into screen tiles for lit_color_texture_program)
 	
 	
 	//start music loop playing:
@@ -151,6 +149,7 @@ bool MonkeyMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_siz
 				* glm::angleAxis(-motion.x * camera->fovy, glm::vec3(0.0f, 1.0f, 0.0f))
 				* glm::angleAxis(motion.y * camera->fovy, glm::vec3(1.0f, 0.0f, 0.0f))
 			);
+			camera->transform->mark_dirty();
 						
 			return true;
 		}
@@ -183,6 +182,7 @@ void MonkeyMode::update(float elapsed) {
 		
 		player->rotation = player_base_rotation * glm::angleAxis(glm::radians(degree), glm::vec3(0.0f, 0.0f, 1.0f));
 		player_base_rotation = player->rotation;
+		player->mark_dirty();
 		
 		
 		// take move
@@ -200,6 +200,7 @@ void MonkeyMode::update(float elapsed) {
 		}
 		
 		player->position += move.y * forward + move.z * up;
+		player->mark_dirty();
 
 				
 	}
@@ -229,6 +230,7 @@ void MonkeyMode::update(float elapsed) {
 					cubes[i]->scale.z -= 0.5f;
 					cubes[i]->scale.z = (cubes[i]->scale.z >= 1.0f) ? cubes[i]->scale.z : 1.0f;
 				}
+				cubes[i]->mark_dirty();
 				
 			}else{
 				cubeChangeRecord += elapsed;
@@ -279,23 +281,7 @@ void MonkeyMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	// TODO: consider using the Light(s) in the scene to do this
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, light->type);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
-	glUseProgram(0);
-	
-	// load light info
-//	glUseProgram(lit_color_texture_program->program);
-//	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));	// all directed alone z
-//	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
-//	glUniform3f(lit_color_texture_program->LIGHT_ENERGY_vec3,
-//				light->energy.x,
-//				light->energy.y,
-//				light->energy.z);
-//	glUseProgram(0);
+	//(the scene's lights are sent to lit_color_texture_program by Scene::draw)
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 	glClearDepth(1.0f); //1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
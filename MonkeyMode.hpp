@@ -58,8 +58,5 @@ struct MonkeyMode : Mode {
 	
 	//camera:
 	Scene::Camera *camera = nullptr;
-	
-	//light:
-	Scene::Light *light = nullptr;
 };
 
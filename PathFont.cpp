@@ -8,11 +8,13 @@
 PathFont::PathFont(uint32_t glyphs_,
 	const float *glyph_widths_,
 	const uint32_t *glyph_char_starts_, const uint8_t *chars_,
-	const uint32_t *glyph_coord_starts_, const float *coords_
+	const uint32_t *glyph_coord_starts_, const float *coords_,
+	const uint32_t *trie_glyphs_, const uint32_t *trie_next_
 	) : glyphs(glyphs_),
 		glyph_widths(glyph_widths_),
 		glyph_char_starts(glyph_char_starts_), chars(chars_),
-		glyph_coord_starts(glyph_coord_starts_), coords(coords_) {
+		glyph_coord_starts(glyph_coord_starts_), coords(coords_),
+		trie_glyphs(trie_glyphs_), trie_next(trie_next_) {
 
 	for (uint32_t i = 0; i < glyphs; ++i) {
 		std::string str(reinterpret_cast< const char * >(chars + glyph_char_starts[i]), reinterpret_cast< const char * >(chars + glyph_char_starts[i+1]));
@@ -19,7 +19,8 @@ struct PathFont {
 	PathFont(uint32_t glyphs,
 		const float *glyph_widths,
 		const uint32_t *glyph_char_starts, const uint8_t *chars,
-		const uint32_t *glyph_coord_starts, const float *coords
+		const uint32_t *glyph_coord_starts, const float *coords,
+		const uint32_t *trie_glyphs, const uint32_t *trie_next
 		);
 	const uint32_t glyphs = 0;
 	const float *glyph_widths = nullptr;
@@ -30,7 +31,31 @@ struct PathFont {
 	const uint32_t *glyph_coord_starts = nullptr; //indices into 'coords' table
 	const float *coords = nullptr;
 
-	//computed in constructor:
+	//lookup trie over the bytes of glyph names (generated by make-PathFont-font.py):
+	// node 0 is the root; entry node * 256 + byte gives the glyph whose name ends with that byte (or -1U)
+	// and the node that continues longer names (or 0 if there are none)
+	const uint32_t *trie_glyphs = nullptr;
+	const uint32_t *trie_next = nullptr;
+
+	//the glyph with the longest name that starts [begin,end), or -1U if there is none:
+	// (sets *length to the length of the glyph's name, or 0 if there is none)
+	uint32_t match(const char *begin, const char *end, uint32_t *length) const {
+		uint32_t glyph = -1U;
+		*length = 0;
+		uint32_t node = 0;
+		for (const char *c = begin; c != end; ++c) {
+			uint32_t entry = node * 256 + uint8_t(*c);
+			if (trie_glyphs[entry] != -1U) {
+				glyph = trie_glyphs[entry];
+				*length = uint32_t(c - begin) + 1;
+			}
+			node = trie_next[entry];
+			if (node == 0) break;
+		}
+		return glyph;
+	}
+
+	//computed in constructor (slower than match(), but handy for looking up glyphs by name):
 	std::map< std::string, uint32_t > glyph_map;
 
 	//the default font:
@@ -12,14 +12,14 @@
 
 #include <random>
 
-GLuint hexapod_meshes_for_lit_color_texture_program = 0;
 Load< MeshBuffer > hexapod_meshes(LoadTagDefault, []() -> MeshBuffer const * {
 	MeshBuffer const *ret = new MeshBuffer(data_path("hexapod.pnct"));
-	hexapod_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+	ret->make_vao_for_program(lit_color_texture_program->program); //(make -- and check -- vertex array object while loading)
 	return ret;
-});
+}, LoadInfo{ "hexapod.pnct", LoadOnWorker, { &lit_color_texture_program } });
 
 Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
+	GLuint vao = hexapod_meshes->make_vao_for_program(lit_color_texture_program->program); //(cached in the MeshBuffer)
 	return new Scene(data_path("hexapod.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = hexapod_meshes->lookup(mesh_name);
 
@@ -28,25 +28,28 @@ Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
 
 		drawable.pipeline = lit_color_texture_program_pipeline;
 
-		drawable.pipeline.vao = hexapod_meshes_for_lit_color_texture_program;
+		drawable.pipeline.vao = vao;
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.position_to_object = mesh.position_to_object;
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
 
 	});
-});
+}, LoadInfo{ "hexapod.scene", LoadOnWorker, { &hexapod_meshes } });
 
-Load< Sound::Sample > dusty_floor_sample(LoadTagDefault, []() -> Sound::Sample const * {
-	return new Sound::Sample(data_path("dusty-floor.opus"));
-});
+//music is streamed (rather than decoded all at once) to save memory and load time:
+Load< Sound::Stream > dusty_floor_stream(LoadTagDefault, []() -> Sound::Stream const * {
+	return new Sound::Stream(data_path("dusty-floor.opus"));
+}, LoadInfo{ "dusty-floor.opus", LoadOnWorker });
 
 PlayMode::PlayMode() : scene(*hexapod_scene) {
 	//get pointers to leg for convenience:
-	for (auto &transform : scene.transforms) {
-		if (transform.name == "Hip.FL") hip = &transform;
-		else if (transform.name == "UpperLeg.FL") upper_leg = &transform;
-		else if (transform.name == "LowerLeg.FL") lower_leg = &transform;
-	}
+	hip = scene.find_transform("Hip.FL");
+	upper_leg = scene.find_transform("UpperLeg.FL");
+	lower_leg = scene.find_transform("LowerLeg.FL");
 	if (hip == nullptr) throw std::runtime_error("Hip not found.");
 	if (upper_leg == nullptr) throw std::runtime_error("Upper leg not found.");
 	if (lower_leg == nullptr) throw std::runtime_error("Lower leg not found.");
@@ -61,7 +64,7 @@ PlayMode::PlayMode() : scene(*hexapod_scene) {
 
 	//start music loop playing:
 	// (note: position will be over-ridden in update())
-	leg_tip_loop = Sound::loop_3D(*dusty_floor_sample, 1.0f, get_leg_tip_position(), 10.0f);
+	leg_tip_loop = Sound::loop_3D(*dusty_floor_stream, 1.0f, get_leg_tip_position(), 10.0f);
 }
 
 PlayMode::~PlayMode() {
@@ -120,6 +123,7 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 				* glm::angleAxis(-motion.x * camera->fovy, glm::vec3(0.0f, 1.0f, 0.0f))
 				* glm::angleAxis(motion.y * camera->fovy, glm::vec3(1.0f, 0.0f, 0.0f))
 			);
+			camera->transform->mark_dirty();
 			return true;
 		}
 	}
@@ -145,6 +149,9 @@ void PlayMode::update(float elapsed) {
 		glm::radians(10.0f * std::sin(wobble * 3.0f * 2.0f * float(M_PI))),
 		glm::vec3(0.0f, 0.0f, 1.0f)
 	);
+	hip->mark_dirty();
+	upper_leg->mark_dirty();
+	lower_leg->mark_dirty();
 
 	//move sound to follow leg tip position:
 	leg_tip_loop->set_position(get_leg_tip_position(), 1.0f / 60.0f);
@@ -169,6 +176,7 @@ void PlayMode::update(float elapsed) {
 		glm::vec3 forward = -frame[2];
 
 		camera->transform->position += move.x * right + move.y * forward;
+		camera->transform->mark_dirty();
 	}
 
 	{ //update listener to camera position:
@@ -189,13 +197,7 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	// TODO: consider using the Light(s) in the scene to do this
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
-	glUseProgram(0);
+	//(the scene's lights are sent to lit_color_texture_program by Scene::draw)
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 	glClearDepth(1.0f); //1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
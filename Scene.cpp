@@ -1,11 +1,17 @@
 #include "Scene.hpp"
 
 #include "gl_errors.hpp"
-#include "read_write_chunk.hpp"
+#include "Mesh.hpp"
+#include "mapped_file.hpp"
+#include "Load.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <map>
 
 //-------------------------
 
@@ -56,21 +62,123 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 	);
 }
 
+//(cached matrices can be used if 't' is in its scene's cache and nothing has been marked dirty since the last update)
+static bool cache_valid(Scene::Transform const *t) {
+	return t->cache_scene && t->cache_index < t->cache_scene->world_cache.transforms.size() && !t->cache_scene->world_cache.any_dirty;
+}
+
 glm::mat4x3 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
+	if (cache_valid(this)) {
+		return cache_scene->world_cache.local_to_world[cache_index];
+	} else if (!parent) {
 		return make_local_to_parent();
 	} else {
 		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
 	}
 }
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
+	if (cache_valid(this)) {
+		return cache_scene->world_cache.world_to_local[cache_index];
+	} else if (!parent) {
 		return make_parent_to_local();
 	} else {
 		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
 	}
 }
 
+void Scene::Transform::mark_dirty() {
+	if (!cache_scene) return;
+	WorldCache &cache = cache_scene->world_cache;
+	if (cache_index < cache.transforms.size()) cache.dirty[cache_index] = 1;
+	cache.any_dirty = true; //(also covers transforms that aren't cached yet, or just got a new parent)
+}
+
+//-------------------------
+
+void Scene::update_world_matrices() const {
+	WorldCache &cache = world_cache;
+
+	//check if hierarchy has changed since the cache was built:
+	// (every transform must still be where the cache put it, and no cached transform may have been removed)
+	bool rebuild = false;
+	size_t cached = 0;
+	for (auto const &t : transforms) {
+		if (t.cache_scene == this && t.cache_index == -1U) continue; //(not cacheable)
+		uint32_t i = t.cache_index;
+		if (t.cache_scene != this || i >= cache.transforms.size() || cache.transforms[i] != &t
+		 || (cache.parents[i] == -1U ? t.parent != nullptr : cache.transforms[cache.parents[i]] != t.parent)) {
+			rebuild = true;
+			break;
+		}
+		cached += 1;
+	}
+	if (cached != cache.transforms.size()) rebuild = true;
+
+	if (!rebuild && !cache.any_dirty) return;
+
+	if (rebuild) {
+		//put transforms in an order where parents come before children:
+		constexpr uint32_t Pending = -2U; //not yet placed
+		constexpr uint32_t Visiting = -3U; //being placed (used to detect cycles)
+		for (auto const &t : transforms) {
+			t.cache_scene = this;
+			t.cache_index = Pending;
+		}
+		cache.transforms.clear();
+		cache.parents.clear();
+		std::vector< Transform const * > chain;
+		for (auto const &t : transforms) {
+			//find any ancestors that still need to be placed:
+			Transform const *at = &t;
+			while (at && at->cache_scene == this && at->cache_index == Pending) {
+				at->cache_index = Visiting;
+				chain.emplace_back(at);
+				at = at->parent;
+			}
+			if (at && at->cache_scene == this && at->cache_index == Visiting) {
+				throw std::runtime_error("transform '" + at->name + "' is its own ancestor.");
+			}
+			//transforms with a parent outside this scene (or with such an ancestor) aren't cached:
+			bool cacheable = (at == nullptr || (at->cache_scene == this && at->cache_index < cache.transforms.size()));
+			while (!chain.empty()) {
+				Transform const *c = chain.back();
+				chain.pop_back();
+				if (cacheable) {
+					c->cache_index = uint32_t(cache.transforms.size());
+					cache.transforms.emplace_back(c);
+					cache.parents.emplace_back(c->parent ? c->parent->cache_index : -1U);
+				} else {
+					c->cache_index = -1U;
+				}
+			}
+		}
+
+		size_t count = cache.transforms.size();
+		cache.local_to_world.assign(count, glm::mat4x3(1.0f));
+		cache.world_to_local.assign(count, glm::mat4x3(1.0f));
+		cache.dirty.assign(count, 1);
+	}
+
+	//recompute world matrices of transforms that were marked dirty (or whose parents were recomputed):
+	for (uint32_t i = 0; i < cache.transforms.size(); ++i) {
+		uint32_t parent = cache.parents[i];
+		if (!cache.dirty[i] && !(parent != -1U && cache.dirty[parent])) continue;
+		cache.dirty[i] = 1; //(so children are recomputed as well)
+
+		Transform const &t = *cache.transforms[i];
+		if (parent == -1U) {
+			cache.local_to_world[i] = t.make_local_to_parent();
+			cache.world_to_local[i] = t.make_parent_to_local();
+		} else {
+			//note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+			cache.local_to_world[i] = cache.local_to_world[parent] * glm::mat4(t.make_local_to_parent());
+			cache.world_to_local[i] = t.make_parent_to_local() * glm::mat4(cache.world_to_local[parent]);
+		}
+	}
+	std::fill(cache.dirty.begin(), cache.dirty.end(), uint8_t(0));
+	cache.any_dirty = false;
+}
+
 //-------------------------
 
 glm::mat4 Scene::Camera::make_projection() const {
@@ -80,17 +188,170 @@ glm::mat4 Scene::Camera::make_projection() const {
 //-------------------------
 
 
-void Scene::draw(Camera const &camera) const {
+//instancing helpers:
+
+//runs of at least this many copies are drawn with instancing:
+static constexpr size_t MinInstances = 4;
+
+//can drawables with these pipelines be drawn in the same instanced draw call?
+static bool same_instance_state(Scene::Drawable::Pipeline const &a, Scene::Drawable::Pipeline const &b) {
+	if (a.program != b.program || a.vao != b.vao) return false;
+	if (a.type != b.type || a.start != b.start || a.count != b.count || a.index_type != b.index_type) return false;
+	if (a.position_to_object != b.position_to_object) return false;
+	if (b.set_uniforms) return false;
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+		if (a.textures[i].texture != b.textures[i].texture) return false;
+		if (a.textures[i].texture != 0 && a.textures[i].target != b.textures[i].target) return false;
+	}
+	return true;
+}
+
+//byte offset of the first index drawn by an indexed pipeline (as wanted by glDrawElements):
+static void const *index_offset(Scene::Drawable::Pipeline const &pipeline) {
+	size_t size = 4;
+	if (pipeline.index_type == GL_UNSIGNED_SHORT) size = 2;
+	else if (pipeline.index_type == GL_UNSIGNED_BYTE) size = 1;
+	return (GLbyte *)0 + pipeline.start * size;
+}
+
+//n.b. the helpers below make OpenGL calls the first time they are used, and add them to '*gl_calls' (see DrawStats::gl_calls)
+
+//buffer (and buffer texture) that per-instance data is streamed through; created on first use:
+static GLuint instance_buffer(uint32_t *gl_calls) {
+	static GLuint buffer = 0;
+	if (buffer == 0) {
+		glGenBuffers(1, &buffer);
+		*gl_calls += 1;
+	}
+	return buffer;
+}
+static GLuint instance_buffer_texture(uint32_t *gl_calls) {
+	static GLuint texture = 0;
+	if (texture == 0) {
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instance_buffer(gl_calls));
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		*gl_calls += 4;
+	}
+	return texture;
+}
+//most instances that fit in the buffer texture at once (each instance is three texels):
+static GLuint max_instances(uint32_t *gl_calls) {
+	static GLuint instances = 0;
+	if (instances == 0) {
+		GLint texels = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+		*gl_calls += 1;
+		instances = std::max(GLuint(texels / 3), GLuint(1));
+	}
+	return instances;
+}
+//(staging area for per-instance data)
+static std::vector< glm::vec4 > instance_data;
+
+//ring buffer that uniform blocks are streamed through; created (and grown) as needed:
+// each draw() call writes its records after the previous call's with one unsynchronized map,
+// and orphans the buffer's storage when it wraps around, so it never waits on the GPU.
+static GLuint uniform_ring = 0;
+static GLsizeiptr uniform_ring_size = 0;
+static GLintptr uniform_ring_next = 0; //(offset of next free byte)
+static constexpr GLsizeiptr MinUniformRingSize = 1 << 20;
+
+//space taken by one uniform block record (blocks must start at multiples of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT):
+static GLsizeiptr uniform_stride(uint32_t *gl_calls) {
+	static GLsizeiptr stride = 0;
+	if (stride == 0) {
+		GLint align = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+		*gl_calls += 1;
+		align = std::max(align, GLint(16));
+		GLsizeiptr size = GLsizeiptr(std::max(sizeof(Scene::FrameUniforms), sizeof(Scene::ObjectUniforms))); //(one stride fits both blocks)
+		stride = (size + align - 1) / align * align;
+	}
+	return stride;
+}
+
+//buffers (and buffer textures) that the light grid is streamed through; created on first use:
+struct StreamTexture {
+	GLuint buffer = 0;
+	GLuint texture = 0;
+};
+static StreamTexture const &stream_texture(StreamTexture *stream, GLenum format, uint32_t *gl_calls) {
+	if (stream->texture == 0) {
+		glGenBuffers(1, &stream->buffer);
+		glGenTextures(1, &stream->texture);
+		glBindTexture(GL_TEXTURE_BUFFER, stream->texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, stream->buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		*gl_calls += 5;
+	}
+	return *stream;
+}
+static StreamTexture const &light_texture(uint32_t *gl_calls) {
+	static StreamTexture stream;
+	return stream_texture(&stream, GL_RGBA32F, gl_calls);
+}
+static StreamTexture const &light_tile_texture(uint32_t *gl_calls) {
+	static StreamTexture stream;
+	return stream_texture(&stream, GL_R32UI, gl_calls);
+}
+
+//normal matrix (inverse transpose) via cofactors; scaled by |det|, which is fine since normals are re-normalized:
+// (unlike glm::inverse, degenerate matrices don't produce NaNs)
+static glm::mat3 normal_matrix(glm::mat3 const &m) {
+	glm::mat3 cofactor(
+		glm::cross(m[1], m[2]),
+		glm::cross(m[2], m[0]),
+		glm::cross(m[0], m[1])
+	);
+	float sign = (glm::dot(m[0], cofactor[0]) < 0.0f ? -1.0f : 1.0f); //(flip if m flips orientation)
+	return cofactor * sign;
+}
+
+//helper: is a (local-space) box entirely outside the view?
+static bool outside_view(glm::mat4 const &local_to_clip, glm::vec3 const &min, glm::vec3 const &max) {
+	//count the corners outside each clip plane:
+	uint32_t outside[5] = {0, 0, 0, 0, 0}; //-x, +x, -y, +y, near
+	for (uint32_t c = 0; c < 8; ++c) {
+		glm::vec4 corner = local_to_clip * glm::vec4(
+			(c & 1 ? max.x : min.x),
+			(c & 2 ? max.y : min.y),
+			(c & 4 ? max.z : min.z),
+			1.0f
+		);
+		outside[0] += (corner.x < -corner.w);
+		outside[1] += (corner.x >  corner.w);
+		outside[2] += (corner.y < -corner.w);
+		outside[3] += (corner.y >  corner.w);
+		outside[4] += (corner.z < -corner.w);
+		//(no far plane test, since cameras use infinite perspective matrices)
+	}
+	//box is outside if all corners are outside the same plane:
+	for (uint32_t p = 0; p < 5; ++p) {
+		if (outside[p] == 8) return true;
+	}
+	return false;
+}
+
+Scene::DrawStats Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
 	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
 	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
-	draw(world_to_clip, world_to_light);
+	return draw(world_to_clip, world_to_light);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+Scene::DrawStats Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	update_world_matrices();
+
+	DrawStats stats;
 
-	//Iterate through all drawables, sending each one to OpenGL:
+	//Build a queue of visible drawables:
+	draw_queue.clear();
 	for (auto const &drawable : drawables) {
+		//drawables in static batches are drawn with their batch (below):
+		if (drawable.batched) continue;
+
 		//Reference to drawable's pipeline for convenience:
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
@@ -101,78 +362,679 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		//skip any drawables that don't contain any vertices:
 		if (pipeline.count == 0) continue;
 
+		//the object-to-world matrix is used for culling and in all three of the uniforms below:
+		assert(drawable.transform); //drawables *must* have a transform
+		Transform const *transform = drawable.transform;
+		glm::mat4x3 object_to_world = (transform->cache_scene == this && transform->cache_index < world_cache.transforms.size()
+			? world_cache.local_to_world[transform->cache_index] //just updated above
+			: transform->make_local_to_world()
+		);
+
+		//skip any drawables that are entirely out of view:
+		if (drawable.min.x <= drawable.max.x && outside_view(world_to_clip * glm::mat4(object_to_world), drawable.min, drawable.max)) {
+			stats.culled += 1;
+			continue;
+		}
+		stats.visible += 1;
+
+		//sort key groups drawables by program, then vertex array, then first texture:
+		// (collisions only make the order less efficient; state changes are found by comparing actual values below)
+		DrawItem item;
+		item.key = (uint64_t(pipeline.program & 0xffff) << 48)
+		         | (uint64_t(pipeline.vao & 0xffff) << 32)
+		         | uint64_t(pipeline.textures[0].texture);
+		item.drawable = &drawable;
+		item.object_to_world = object_to_world;
+		item.batch = nullptr;
+		draw_queue.emplace_back(item);
+	}
+
+	//Add static batches, with ranges for just their visible members:
+	for (auto const &batch : static_batches) {
+		batch.firsts.clear();
+		batch.counts.clear();
+		for (auto const &member : batch.members) {
+			if (member.min.x <= member.max.x && outside_view(world_to_clip, member.min, member.max)) {
+				stats.culled += 1;
+				continue;
+			}
+			stats.batched_draws += 1;
+			if (!batch.firsts.empty() && batch.firsts.back() + batch.counts.back() == member.first) {
+				batch.counts.back() += member.count; //(extend previous range)
+			} else {
+				batch.firsts.emplace_back(member.first);
+				batch.counts.emplace_back(member.count);
+			}
+		}
+		if (batch.firsts.empty()) continue;
+		stats.visible += 1;
+
+		Scene::Drawable::Pipeline const &pipeline = batch.drawable.pipeline;
+		DrawItem item;
+		item.key = (uint64_t(pipeline.program & 0xffff) << 48)
+		         | (uint64_t(pipeline.vao & 0xffff) << 32)
+		         | uint64_t(pipeline.textures[0].texture);
+		item.drawable = &batch.drawable;
+		item.object_to_world = glm::mat4x3(1.0f);
+		item.batch = &batch;
+		draw_queue.emplace_back(item);
+	}
+
+	//(stable so that drawables with the same state draw in the same order every frame)
+	std::stable_sort(draw_queue.begin(), draw_queue.end(), [](DrawItem const &a, DrawItem const &b) {
+		if (a.key != b.key) return a.key < b.key;
+		//keep copies of the same vertices together so they can be instanced:
+		Drawable::Pipeline const &pa = a.drawable->pipeline;
+		Drawable::Pipeline const &pb = b.drawable->pipeline;
+		if (pa.start != pb.start) return pa.start < pb.start;
+		if (pa.count != pb.count) return pa.count < pb.count;
+		return pa.type < pb.type;
+	});
+
+	//Find runs of drawables that will be drawn with instancing:
+	size_t object_records = 0;
+	bool uses_blocks = false; //(does any queued pipeline read the uniform blocks?)
+	for (size_t q = 0; q < draw_queue.size(); /* later */) {
+		DrawItem &item = draw_queue[q];
+		Scene::Drawable::Pipeline const &pipeline = item.drawable->pipeline;
+
+		//find how many following drawables could be drawn as instances along with this one:
+		size_t run = 1;
+		if (pipeline.INSTANCED_bool != -1U && !pipeline.set_uniforms
+		 && (pipeline.POSITION_TO_OBJECT_mat4x3 != -1U || pipeline.position_to_object == glm::mat4x3(1.0f))) {
+			while (q + run < draw_queue.size() && same_instance_state(pipeline, draw_queue[q + run].drawable->pipeline)) {
+				++run;
+			}
+		}
+		//(for just a few copies, setting up instancing isn't worth it)
+		if (run < MinInstances) run = 1;
+
+		item.run = uint32_t(run);
+		item.object_offset = 0;
+		if (pipeline.Object_block != -1U) uses_blocks = true;
+		if (run == 1 && pipeline.Object_block != -1U) object_records += 1;
+		q += run;
+	}
+
+	//Only programs that use uniform blocks read the per-frame block and the lights, so if nothing queued does,
+	// skip writing the uniform ring and sorting and sending the lights:
+	if (uses_blocks) {
+		//Write the per-frame uniform block and every per-object uniform block into the ring buffer with one map:
+		GLsizeiptr stride = uniform_stride(&stats.gl_calls);
+		GLsizeiptr bytes = GLsizeiptr(1 + object_records) * stride;
+		if (uniform_ring == 0) {
+			glGenBuffers(1, &uniform_ring);
+			stats.gl_calls += 1;
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, uniform_ring);
+		stats.gl_calls += 1;
+		if (uniform_ring_next + bytes > uniform_ring_size) {
+			//wrapped around: orphan the old storage (the GPU may still be reading it) and start over at the front:
+			uniform_ring_size = std::max(uniform_ring_size, MinUniformRingSize);
+			while (uniform_ring_size < bytes) uniform_ring_size *= 2;
+			glBufferData(GL_UNIFORM_BUFFER, uniform_ring_size, nullptr, GL_STREAM_DRAW);
+			stats.gl_calls += 1;
+			uniform_ring_next = 0;
+		}
+		GLintptr frame_offset = uniform_ring_next;
+		char *mapped = reinterpret_cast< char * >(glMapBufferRange(GL_UNIFORM_BUFFER, frame_offset, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+		));
+		stats.gl_calls += 1;
+		if (!mapped) {
+			throw std::runtime_error("Failed to map uniform ring buffer.");
+		}
+		uniform_ring_next += bytes;
+
+		{ //per-frame block -- camera and light grid size:
+			FrameUniforms frame;
+			frame.WORLD_TO_CLIP = world_to_clip;
+			for (uint32_t c = 0; c < 4; ++c) {
+				frame.WORLD_TO_LIGHT[c] = glm::vec4(world_to_light[c], 0.0f);
+			}
+			frame.LIGHT_TILES = glm::ivec2(LightGrid::TilesX, LightGrid::TilesY);
+			std::memcpy(mapped, &frame, sizeof(frame));
+		}
+
+		//per-object blocks:
+		GLintptr object_offset = frame_offset + stride;
+		for (size_t q = 0; q < draw_queue.size(); q += draw_queue[q].run) {
+			DrawItem &item = draw_queue[q];
+			Scene::Drawable::Pipeline const &pipeline = item.drawable->pipeline;
+			if (item.run != 1 || pipeline.Object_block == -1U) continue;
+
+			//(quantized positions are taken to object space first; normals aren't quantized this way)
+			glm::mat4 object_to_world = glm::mat4(item.object_to_world);
+			glm::mat4 position_to_object = glm::mat4(pipeline.position_to_object);
+			glm::mat4x3 object_to_light = world_to_light * object_to_world;
+			glm::mat4x3 position_to_light = object_to_light * position_to_object;
+			glm::mat3 normal_to_light = normal_matrix(glm::mat3(object_to_light));
+
+			ObjectUniforms object;
+			object.OBJECT_TO_CLIP = world_to_clip * object_to_world * position_to_object;
+			for (uint32_t c = 0; c < 4; ++c) {
+				object.OBJECT_TO_LIGHT[c] = glm::vec4(position_to_light[c], 0.0f);
+			}
+			for (uint32_t c = 0; c < 3; ++c) {
+				object.NORMAL_TO_LIGHT[c] = glm::vec4(normal_to_light[c], 0.0f);
+			}
+			std::memcpy(mapped + (object_offset - frame_offset), &object, sizeof(object));
+			item.object_offset = object_offset;
+			object_offset += stride;
+		}
+
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBufferRange(GL_UNIFORM_BUFFER, Drawable::Pipeline::FrameBlockBinding, uniform_ring, frame_offset, sizeof(FrameUniforms));
+		//instanced draws don't read the per-object block, but it still needs a valid range bound;
+		// point it at the frame record (one stride fits either block) until a non-instanced draw rebinds it:
+		glBindBufferRange(GL_UNIFORM_BUFFER, Drawable::Pipeline::ObjectBlockBinding, uniform_ring, frame_offset, sizeof(ObjectUniforms));
+		stats.gl_calls += 3;
+
+		//Sort lights into tiles and send them (as buffer textures) to their texture units:
+		cull_lights(world_to_clip, world_to_light, &light_grid);
+		stats.lights = uint32_t(light_grid.lights.size() / 3);
+		stats.light_tile_entries = uint32_t(light_grid.tiles.size() - (LightGrid::TilesX * LightGrid::TilesY + 1));
+		{
+			StreamTexture const &lights = light_texture(&stats.gl_calls);
+			StreamTexture const &tiles = light_tile_texture(&stats.gl_calls);
+			glBindBuffer(GL_TEXTURE_BUFFER, lights.buffer);
+			glBufferData(GL_TEXTURE_BUFFER, light_grid.lights.size() * sizeof(glm::vec4), light_grid.lights.data(), GL_STREAM_DRAW);
+			glBindBuffer(GL_TEXTURE_BUFFER, tiles.buffer);
+			glBufferData(GL_TEXTURE_BUFFER, light_grid.tiles.size() * sizeof(uint32_t), light_grid.tiles.data(), GL_STREAM_DRAW);
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+			glActiveTexture(GL_TEXTURE0 + Drawable::Pipeline::LightTextureUnit);
+			glBindTexture(GL_TEXTURE_BUFFER, lights.texture);
+			glActiveTexture(GL_TEXTURE0 + Drawable::Pipeline::LightTileTextureUnit);
+			glBindTexture(GL_TEXTURE_BUFFER, tiles.texture);
+			stats.gl_calls += 9;
+		}
+	}
+
+	//Send drawables to OpenGL, only changing state when needed:
+	GLuint current_program = 0;
+	GLuint current_vao = 0;
+	Drawable::Pipeline::TextureInfo current_textures[Drawable::Pipeline::TextureCount];
+	uint32_t current_active = 0;
+	glActiveTexture(GL_TEXTURE0);
+	stats.gl_calls += 1;
+
+	//helper: bind the textures a pipeline wants (units with texture 0 are left empty, as if nothing was ever bound there):
+	auto bind_textures = [&](Drawable::Pipeline const &pipeline) {
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			Drawable::Pipeline::TextureInfo const &want = pipeline.textures[i];
+			Drawable::Pipeline::TextureInfo &have = current_textures[i];
+			if (want.texture == have.texture && (want.texture == 0 || want.target == have.target)) continue;
+			if (current_active != i) {
+				glActiveTexture(GL_TEXTURE0 + i);
+				stats.gl_calls += 1;
+				current_active = i;
+			}
+			if (have.texture != 0 && (want.texture == 0 || want.target != have.target)) {
+				glBindTexture(have.target, 0);
+				stats.gl_calls += 1;
+			}
+			if (want.texture != 0) {
+				glBindTexture(want.target, want.texture);
+				stats.gl_calls += 1;
+			}
+			have = want;
+			stats.texture_changes += 1;
+		}
+	};
+	bool bound_instance_texture = false;
+
+	for (size_t q = 0; q < draw_queue.size(); /* later */) {
+		DrawItem const &item = draw_queue[q];
+		Scene::Drawable::Pipeline const &pipeline = item.drawable->pipeline;
+		size_t run = item.run;
 
 		//Set shader program:
-		glUseProgram(pipeline.program);
+		if (pipeline.program != current_program) {
+			glUseProgram(pipeline.program);
+			stats.gl_calls += 1;
+			current_program = pipeline.program;
+			stats.program_changes += 1;
+		}
 
 		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		if (pipeline.vao != current_vao) {
+			glBindVertexArray(pipeline.vao);
+			stats.gl_calls += 1;
+			current_vao = pipeline.vao;
+			stats.vao_changes += 1;
+		}
 
-		//Configure program uniforms:
+		if (run > 1) {
+			//Draw all the copies with instancing:
+			// (programs using uniform blocks read WORLD_TO_CLIP and WORLD_TO_LIGHT from the per-frame block)
+			if (pipeline.WORLD_TO_CLIP_mat4 != -1U) {
+				glUniformMatrix4fv(pipeline.WORLD_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+				stats.gl_calls += 1;
+			}
+			if (pipeline.WORLD_TO_LIGHT_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(pipeline.WORLD_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(world_to_light));
+				stats.gl_calls += 1;
+			}
+			if (pipeline.POSITION_TO_OBJECT_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(pipeline.POSITION_TO_OBJECT_mat4x3, 1, GL_FALSE, glm::value_ptr(pipeline.position_to_object));
+				stats.gl_calls += 1;
+			}
+			glUniform1i(pipeline.INSTANCED_bool, GL_TRUE);
+			stats.gl_calls += 1;
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+			bind_textures(pipeline);
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
-		}
+			if (!bound_instance_texture) {
+				glActiveTexture(GL_TEXTURE0 + Drawable::Pipeline::InstanceTextureUnit);
+				current_active = Drawable::Pipeline::InstanceTextureUnit;
+				glBindTexture(GL_TEXTURE_BUFFER, instance_buffer_texture(&stats.gl_calls));
+				stats.gl_calls += 2;
+				bound_instance_texture = true;
+			}
+
+			//send object-to-world matrices (as rows) in batches that fit in the buffer texture:
+			for (size_t first = q; first < q + run; first += max_instances(&stats.gl_calls)) {
+				size_t count = std::min(q + run - first, size_t(max_instances(&stats.gl_calls)));
+				instance_data.clear();
+				for (size_t i = first; i < first + count; ++i) {
+					glm::mat4x3 const &m = draw_queue[i].object_to_world;
+					for (uint32_t r = 0; r < 3; ++r) {
+						instance_data.emplace_back(m[0][r], m[1][r], m[2][r], m[3][r]);
+					}
+				}
+				glBindBuffer(GL_TEXTURE_BUFFER, instance_buffer(&stats.gl_calls));
+				glBufferData(GL_TEXTURE_BUFFER, instance_data.size() * sizeof(glm::vec4), instance_data.data(), GL_STREAM_DRAW);
+				glBindBuffer(GL_TEXTURE_BUFFER, 0);
+				stats.gl_calls += 3;
+
+				if (pipeline.index_type == GL_NONE) {
+					glDrawArraysInstanced(pipeline.type, pipeline.start, pipeline.count, GLsizei(count));
+				} else {
+					glDrawElementsInstanced(pipeline.type, pipeline.count, pipeline.index_type, index_offset(pipeline), GLsizei(count));
+				}
+				stats.gl_calls += 1;
+				stats.draw_calls += 1;
+			}
+			stats.instanced_draws += uint32_t(run);
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+			glUniform1i(pipeline.INSTANCED_bool, GL_FALSE);
+			stats.gl_calls += 1;
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+			q += run;
+			continue;
 		}
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+		//Configure program uniforms:
+		if (pipeline.Object_block != -1U) {
+			//point the per-object block at this drawable's record (written above):
+			glBindBufferRange(GL_UNIFORM_BUFFER, Drawable::Pipeline::ObjectBlockBinding, uniform_ring, item.object_offset, sizeof(ObjectUniforms));
+			stats.gl_calls += 1;
+		} else {
+			glm::mat4x3 const &object_to_world = item.object_to_world;
+
+			//(quantized positions are taken to object space first; normals aren't quantized this way)
+			glm::mat4 position_to_object = glm::mat4(pipeline.position_to_object);
+
+			//OBJECT_TO_CLIP takes vertices from object space to clip space:
+			if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+				glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world) * position_to_object;
+				glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+				stats.gl_calls += 1;
+			}
+
+			//the object-to-light matrix is used in the next two uniforms:
+			glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+
+			//OBJECT_TO_CLIP takes vertices from object space to light space:
+			if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+				glm::mat4x3 position_to_light = object_to_light * position_to_object;
+				glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(position_to_light));
+				stats.gl_calls += 1;
+			}
+
+			//NORMAL_TO_CLIP takes normals from object space to light space:
+			if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+				glm::mat3 normal_to_light = normal_matrix(glm::mat3(object_to_light));
+				glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+				stats.gl_calls += 1;
+			}
 		}
 
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
 		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+		bind_textures(pipeline);
+
+		//draw the object:
+		if (item.batch) {
+			glMultiDrawArrays(pipeline.type, item.batch->firsts.data(), item.batch->counts.data(), GLsizei(item.batch->firsts.size()));
+		} else if (pipeline.index_type == GL_NONE) {
+			glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		} else {
+			glDrawElements(pipeline.type, pipeline.count, pipeline.index_type, index_offset(pipeline));
+		}
+		stats.gl_calls += 1;
+		stats.draw_calls += 1;
+
+		q += 1;
+	}
+
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (current_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(current_textures[i].target, 0);
+			stats.gl_calls += 2;
+		}
+	}
+	if (bound_instance_texture) {
+		glActiveTexture(GL_TEXTURE0 + Drawable::Pipeline::InstanceTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		stats.gl_calls += 2;
+	}
+	if (uses_blocks) {
+		glActiveTexture(GL_TEXTURE0 + Drawable::Pipeline::LightTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glActiveTexture(GL_TEXTURE0 + Drawable::Pipeline::LightTileTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		stats.gl_calls += 5;
+	}
+	glActiveTexture(GL_TEXTURE0);
+	stats.gl_calls += 1;
+
+	glUseProgram(0);
+	glBindVertexArray(0);
+	stats.gl_calls += 2;
+
+	GL_ERRORS();
+	stats.gl_calls += 1; //(GL_ERRORS calls glGetError at least once)
+
+	return stats;
+}
+
+void Scene::cull_lights(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, LightGrid *grid_) const {
+	assert(grid_);
+	LightGrid &grid = *grid_;
+	constexpr uint32_t TileCount = LightGrid::TilesX * LightGrid::TilesY;
+
+	//range of tiles covered by each light in view:
+	typedef LightGrid::Cover Cover;
+	std::vector< Cover > &covers = grid.covers;
+	covers.clear();
+
+	grid.lights.clear();
+	for (auto const &light : lights) {
+		assert(light.transform);
+		glm::mat4x3 light_to_world = light.transform->make_local_to_world();
+		glm::vec3 at = light_to_world[3];
+
+		Cover cover;
+		cover.light = uint32_t(grid.lights.size() / 3);
+		cover.min = glm::uvec2(0);
+		cover.max = glm::uvec2(LightGrid::TilesX - 1, LightGrid::TilesY - 1);
+
+		float type = 3.0f;
+		float range = 0.0f;
+		if (light.type == Light::Point || light.type == Light::Spot) {
+			type = (light.type == Light::Point ? 0.0f : 2.0f);
+			//falloff is energy / distance^2, so the light is too dim to matter past:
+			float energy = std::max(light.energy.x, std::max(light.energy.y, light.energy.z));
+			range = std::sqrt(std::max(energy, 0.0f) / LightCutoff);
+
+			//skip lights whose range is entirely out of view:
+			glm::vec3 min = at - glm::vec3(range);
+			glm::vec3 max = at + glm::vec3(range);
+			if (outside_view(world_to_clip, min, max)) continue;
+
+			//find the screen rectangle covered by the range's bounding box:
+			// (if part of the box is behind the camera, the rectangle is the whole screen)
+			glm::vec2 lo = glm::vec2( std::numeric_limits< float >::infinity());
+			glm::vec2 hi = glm::vec2(-std::numeric_limits< float >::infinity());
+			bool behind = false;
+			for (uint32_t c = 0; c < 8; ++c) {
+				glm::vec4 corner = world_to_clip * glm::vec4(
+					(c & 1 ? max.x : min.x),
+					(c & 2 ? max.y : min.y),
+					(c & 4 ? max.z : min.z),
+					1.0f
+				);
+				if (corner.w <= 1e-6f) {
+					behind = true;
+					break;
+				}
+				glm::vec2 ndc = glm::vec2(corner) / corner.w;
+				lo = glm::min(lo, ndc);
+				hi = glm::max(hi, ndc);
+			}
+			if (!behind) {
+				auto to_tile = [](float ndc, uint32_t tiles) {
+					float t = std::floor((ndc * 0.5f + 0.5f) * float(tiles));
+					return uint32_t(std::min(std::max(t, 0.0f), float(tiles - 1)));
+				};
+				cover.min = glm::uvec2(to_tile(lo.x, LightGrid::TilesX), to_tile(lo.y, LightGrid::TilesY));
+				cover.max = glm::uvec2(to_tile(hi.x, LightGrid::TilesX), to_tile(hi.y, LightGrid::TilesY));
 			}
+		} else if (light.type == Light::Hemisphere) {
+			type = 1.0f;
 		}
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		covers.emplace_back(cover);
+		grid.lights.emplace_back(world_to_light * glm::vec4(at, 1.0f), type);
+		grid.lights.emplace_back(glm::normalize(glm::mat3(world_to_light) * -light_to_world[2]), std::cos(0.5f * light.spot_fov)); //(lights point along -z)
+		grid.lights.emplace_back(light.energy, range);
+	}
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
+	//no lights? use a white hemisphere light shining down:
+	if (lights.empty()) {
+		Cover cover;
+		cover.light = 0;
+		cover.min = glm::uvec2(0);
+		cover.max = glm::uvec2(LightGrid::TilesX - 1, LightGrid::TilesY - 1);
+		covers.emplace_back(cover);
+		grid.lights.emplace_back(0.0f, 0.0f, 0.0f, 1.0f);
+		grid.lights.emplace_back(0.0f, 0.0f,-1.0f, 0.0f);
+		grid.lights.emplace_back(1.0f, 1.0f, 0.95f, 0.0f);
+	}
+
+	//count lights per tile, then lay out lists after the offsets, then fill them in:
+	grid.tiles.assign(TileCount + 1, 0);
+	for (auto const &cover : covers) {
+		for (uint32_t y = cover.min.y; y <= cover.max.y; ++y) {
+			for (uint32_t x = cover.min.x; x <= cover.max.x; ++x) {
+				grid.tiles[y * LightGrid::TilesX + x] += 1;
 			}
 		}
-		glActiveTexture(GL_TEXTURE0);
+	}
+	uint32_t offset = TileCount + 1;
+	for (uint32_t t = 0; t <= TileCount; ++t) {
+		uint32_t count = grid.tiles[t];
+		grid.tiles[t] = offset;
+		offset += count;
+	}
+	grid.tiles.resize(offset);
+	std::vector< uint32_t > &next = grid.next;
+	next.assign(grid.tiles.begin(), grid.tiles.begin() + TileCount);
+	for (auto const &cover : covers) {
+		for (uint32_t y = cover.min.y; y <= cover.max.y; ++y) {
+			for (uint32_t x = cover.min.x; x <= cover.max.x; ++x) {
+				grid.tiles[next[y * LightGrid::TilesX + x]++] = cover.light;
+			}
+		}
+	}
+}
 
+
+//-------------------------
+//static batching helpers:
+
+//batched vertices use the same layout as "pnct" chunks:
+typedef MeshBuffer::Vertex BatchVertex;
+
+//the attributes batches bind, and their formats:
+struct BatchAttrib {
+	char const *name;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	size_t offset; //in BatchVertex
+};
+static BatchAttrib const BatchAttribs[4] = {
+	{ "Position", 3, GL_FLOAT, GL_FALSE, offsetof(BatchVertex, Position) },
+	{ "Normal", 3, GL_FLOAT, GL_FALSE, offsetof(BatchVertex, Normal) },
+	{ "Color", 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(BatchVertex, Color) },
+	{ "TexCoord", 2, GL_FLOAT, GL_FALSE, offsetof(BatchVertex, TexCoord) },
+};
+
+//append the triangles a drawable draws to 'out', in world space, reading them from its mesh buffer's CPU-side data;
+// returns false (and appends nothing) if the drawable can't be batched:
+static bool read_world_triangles(Scene::Drawable const &drawable, glm::mat4x3 const &object_to_world, std::vector< BatchVertex > *out) {
+	Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+	if (pipeline.type != GL_TRIANGLES || pipeline.set_uniforms) return false;
+	MeshBuffer const *buffer = drawable.mesh_buffer;
+	if (!buffer || buffer->vertices.empty()) return false; //(quantized meshes aren't batched)
+
+	//(the pipeline's start counts from the start of the buffer's arena block; the CPU-side data from the start of the file)
+	size_t first = 0;
+	if (pipeline.index_type == GL_NONE) {
+		if (pipeline.start < buffer->vertex_begin) return false;
+		first = pipeline.start - buffer->vertex_begin;
+		if (first + pipeline.count > buffer->vertices.size()) return false;
+	} else if (pipeline.index_type == GL_UNSIGNED_INT) {
+		if (pipeline.start < buffer->element_begin) return false;
+		first = pipeline.start - buffer->element_begin;
+		if (first + pipeline.count > buffer->elements.size()) return false;
+	} else {
+		return false;
 	}
 
-	glUseProgram(0);
-	glBindVertexArray(0);
+	//copy triangles to world space:
+	// (elements were checked against the vertex range when the buffer was loaded)
+	glm::mat4x3 position_to_world = object_to_world * glm::mat4(pipeline.position_to_object);
+	glm::mat3 normal_to_world = glm::inverse(glm::transpose(glm::mat3(object_to_world)));
+	out->reserve(out->size() + pipeline.count);
+	for (size_t i = first; i < first + pipeline.count; ++i) {
+		BatchVertex vertex = buffer->vertices[pipeline.index_type == GL_NONE ? i : buffer->elements[i]];
+		vertex.Position = position_to_world * glm::vec4(vertex.Position, 1.0f);
+		vertex.Normal = normal_to_world * vertex.Normal;
+		out->emplace_back(vertex);
+	}
+	return true;
+}
+
+//only groups of at least this many static drawables are batched:
+static constexpr size_t MinBatch = 2;
+
+void Scene::build_static_batches() {
+	clear_static_batches();
+	update_world_matrices();
+
+	//group static drawables that could share a draw call (same program and textures):
+	std::map< std::vector< GLuint >, std::vector< Drawable * > > groups;
+	for (auto &drawable : drawables) {
+		if (!drawable.is_static) continue;
+		Drawable::Pipeline const &pipeline = drawable.pipeline;
+		if (pipeline.program == 0 || pipeline.vao == 0 || pipeline.count == 0) continue;
+		std::vector< GLuint > key;
+		key.emplace_back(pipeline.program);
+		for (auto const &texture : pipeline.textures) {
+			key.emplace_back(texture.texture);
+			key.emplace_back(texture.texture != 0 ? texture.target : 0);
+		}
+		groups[key].emplace_back(&drawable);
+	}
+
+	std::vector< BatchVertex > vertices;
+	for (auto const &[key, group] : groups) {
+		if (group.size() < MinBatch) continue;
+
+		static_batches.emplace_back();
+		StaticBatch &batch = static_batches.back();
+		std::vector< Drawable * > batched;
+
+		//copy triangles into the batch:
+		vertices.clear();
+		for (Drawable *drawable : group) {
+			StaticBatch::Member member;
+			member.first = GLint(vertices.size());
+			if (!read_world_triangles(*drawable, drawable->transform->make_local_to_world(), &vertices)) continue;
+			member.count = GLsizei(vertices.size() - member.first);
+			for (size_t v = member.first; v < vertices.size(); ++v) {
+				member.min = glm::min(member.min, vertices[v].Position);
+				member.max = glm::max(member.max, vertices[v].Position);
+			}
+			batch.drawable.min = glm::min(batch.drawable.min, member.min);
+			batch.drawable.max = glm::max(batch.drawable.max, member.max);
+			batch.members.emplace_back(member);
+			batched.emplace_back(drawable);
+		}
+		if (batched.size() < MinBatch) {
+			static_batches.pop_back();
+			continue;
+		}
+		for (Drawable *drawable : batched) {
+			drawable->batched = true;
+		}
+
+		//upload:
+		glGenBuffers(1, &batch.buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, batch.buffer);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(BatchVertex), vertices.data(), GL_STATIC_DRAW);
+
+		//draw with the same program and textures as the batched drawables, but from the batch's vertices:
+		Drawable::Pipeline &pipeline = batch.drawable.pipeline;
+		pipeline = batched[0]->pipeline;
+		pipeline.start = 0;
+		pipeline.count = GLuint(vertices.size());
+		pipeline.index_type = GL_NONE;
+		pipeline.position_to_object = glm::mat4x3(1.0f);
+		pipeline.INSTANCED_bool = -1U;
+
+		glGenVertexArrays(1, &pipeline.vao);
+		glBindVertexArray(pipeline.vao);
+		for (auto const &attrib : BatchAttribs) {
+			GLint location = glGetAttribLocation(pipeline.program, attrib.name);
+			if (location == -1) continue;
+			glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, sizeof(BatchVertex), (GLbyte *)0 + attrib.offset);
+			glEnableVertexAttribArray(location);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 
 	GL_ERRORS();
 }
 
+void Scene::clear_static_batches() {
+	for (auto &batch : static_batches) {
+		glDeleteVertexArrays(1, &batch.drawable.pipeline.vao);
+		glDeleteBuffers(1, &batch.buffer);
+	}
+	static_batches.clear();
+	for (auto &drawable : drawables) {
+		drawable.batched = false;
+	}
+}
+
+Scene::~Scene() {
+	clear_static_batches();
+	//(transforms are destroyed after name_index, so they shouldn't try to update it)
+	for (auto &t : transforms) t.name_scene = nullptr;
+}
+
 
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
+	//chunks are viewed directly in the mapped file:
+	// (chunks are looked up by magic, so order doesn't matter and unknown chunks are skipped)
+	MappedFile mapped(filename);
+	load_stats_read(mapped.size);
+	ChunkTable chunks(mapped.begin(), mapped.end());
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkSpan< char > names;
+	chunks.read("str0", &names);
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -183,8 +1045,8 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	ChunkSpan< HierarchyEntry > hierarchy;
+	chunks.read("xfh0", &hierarchy);
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +1054,8 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	ChunkSpan< MeshEntry > meshes;
+	chunks.read("msh0", &meshes);
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +1064,8 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
+	ChunkSpan< CameraEntry > cameras;
+	chunks.read("cam0", &cameras);
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,8 +1076,8 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
+	ChunkSpan< LightEntry > lights;
+	chunks.read("lmp0", &lights);
 
 
 	//--------------------------------
@@ -302,14 +1164,72 @@ void Scene::load(std::string const &filename,
 	}
 
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	load_extra(chunks, names, hierarchy_transforms);
+
+
+
+}
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
+//-------------------------
+
+Scene::Transform::~Transform() {
+	//the name index would otherwise be left pointing at this transform:
+	if (name_scene) name_scene->name_index.indexed_transforms = -1ULL;
+}
+
+void Scene::index_names() {
+	NameIndex &index = name_index;
+	index.by_name.clear();
+	index.by_name.reserve(transforms.size());
+	for (auto &t : transforms) {
+		t.name_scene = this;
+		index.by_name.emplace_back(&t);
+	}
+	std::stable_sort(index.by_name.begin(), index.by_name.end(), [](Transform const *a, Transform const *b) {
+		return a->name < b->name;
+	});
+
+	//hash table of first index of each name, at most half full:
+	size_t size = 16;
+	while (size < 2 * index.by_name.size()) size *= 2;
+	index.slots.assign(size, -1U);
+	for (uint32_t i = 0; i < index.by_name.size(); ++i) {
+		std::string const &name = index.by_name[i]->name;
+		if (i > 0 && index.by_name[i-1]->name == name) continue; //(only the first transform with each name goes in the table)
+		size_t slot = std::hash< std::string >()(name) & (size - 1);
+		while (index.slots[slot] != -1U) slot = (slot + 1) & (size - 1);
+		index.slots[slot] = i;
 	}
 
+	index.indexed_transforms = transforms.size();
+}
 
+Scene::Transform *Scene::find_transform(std::string const &name) {
+	if (name_index.indexed_transforms != transforms.size()) index_names();
+	std::vector< uint32_t > const &slots = name_index.slots;
+	size_t slot = std::hash< std::string >()(name) & (slots.size() - 1);
+	while (slots[slot] != -1U) {
+		Transform *t = name_index.by_name[slots[slot]];
+		if (t->name == name) return t;
+		slot = (slot + 1) & (slots.size() - 1);
+	}
+	return nullptr;
+}
 
+Scene::TransformSpan Scene::find_transforms(std::string const &prefix) {
+	if (name_index.indexed_transforms != transforms.size()) index_names();
+	std::vector< Transform * > const &by_name = name_index.by_name;
+	//names with the prefix are contiguous, starting where the prefix itself would sort:
+	auto begin = std::lower_bound(by_name.begin(), by_name.end(), prefix, [](Transform const *t, std::string const &p) {
+		return t->name < p;
+	});
+	auto end = std::partition_point(begin, by_name.end(), [&prefix](Transform const *t) {
+		return t->name.compare(0, prefix.size(), prefix) == 0;
+	});
+	TransformSpan span;
+	span.first = by_name.data() + (begin - by_name.begin());
+	span.last = by_name.data() + (end - by_name.begin());
+	return span;
 }
 
 //-------------------------
@@ -334,6 +1254,12 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 
 	transform_to_transform.clear();
 
+	clear_static_batches();
+
+	//world matrices will be recomputed (and names re-indexed) for the new transforms:
+	world_cache = WorldCache();
+	name_index = NameIndex();
+
 	//null transform maps to itself:
 	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
 
@@ -358,9 +1284,11 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 	}
 
 	//copy other's drawables, updating transform pointers:
+	// (static batches aren't copied, so copied drawables are drawn individually until build_static_batches() is called)
 	drawables = other.drawables;
 	for (auto &d : drawables) {
 		d.transform = transform_to_transform.at(d.transform);
+		d.batched = false;
 	}
 
 	//copy other's cameras, updating transform pointers:
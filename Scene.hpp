@@ -11,17 +11,21 @@
  */
 
 #include "GL.hpp"
+#include "read_write_chunk.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <list>
+#include <limits>
 #include <memory>
 #include <functional>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
+struct MeshBuffer;
+
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
@@ -40,13 +44,26 @@ struct Scene {
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
 		// ..relative to the world:
+		//  (these return the matrices cached by Scene::update_world_matrices(), unless a transform in the scene
+		//   has been marked dirty since -- then they are computed by walking up the hierarchy)
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
+		//call after changing position, rotation, scale, or parent, so that cached world matrices are recomputed:
+		void mark_dirty();
+
+		//(used to find this transform's entry in its scene's world matrix cache)
+		mutable Scene const *cache_scene = nullptr;
+		mutable uint32_t cache_index = -1U;
+
+		//(scene whose name index refers to this transform; its index is marked out of date when this transform is destroyed)
+		Scene *name_scene = nullptr;
+
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
+		~Transform();
 	};
 
 	struct Drawable {
@@ -54,6 +71,17 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//local-space bounding box (e.g., copied from Mesh), used to skip drawing things that are out of view:
+		// (the default, an empty box, means "always draw")
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		//drawables that won't move (or change pipeline) may be marked static, so build_static_batches() can merge them:
+		// (their triangles are read from the CPU-side copy in 'mesh_buffer', the MeshBuffer their pipeline draws from)
+		bool is_static = false;
+		MeshBuffer const *mesh_buffer = nullptr;
+		bool batched = false; //(set by build_static_batches(); batched drawables are drawn as part of their batch)
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -64,6 +92,8 @@ struct Scene {
 			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
+			GLenum index_type = GL_NONE; //if not GL_NONE, draw with glDrawElements instead ('start' and 'count' are then in indices)
+			glm::mat4x3 position_to_object = glm::mat4x3(1.0f); //for quantized meshes, takes Position attributes to object space (copy from Mesh)
 
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
@@ -72,8 +102,26 @@ struct Scene {
 
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
+			//instancing: drawables that share all of the pipeline state above are drawn with one glDrawArraysInstanced call
+			// if their program supports it (i.e., has an 'INSTANCED' uniform; -1U means no instancing support).
+			//When INSTANCED is true, the program should read rows of each instance's object-to-world matrix from the
+			// samplerBuffer bound to InstanceTextureUnit (three texels per instance, starting at 3 * gl_InstanceID)
+			// and compute its matrices using WORLD_TO_CLIP and WORLD_TO_LIGHT instead of the uniforms above:
+			GLuint INSTANCED_bool = -1U; //uniform location for flag that switches to per-instance matrices
+			GLuint WORLD_TO_CLIP_mat4 = -1U; //uniform location for world to clip space matrix (used when instancing)
+			GLuint WORLD_TO_LIGHT_mat4x3 = -1U; //uniform location for world to light space matrix (used when instancing)
+			GLuint POSITION_TO_OBJECT_mat4x3 = -1U; //uniform location for position_to_object (used when instancing; if -1U, quantized meshes aren't instanced)
+
+			//uniform blocks: instead of the matrix uniforms above, programs may read std140 blocks laid out like
+			// Scene::FrameUniforms (bound at FrameBlockBinding; also holds WORLD_TO_CLIP/WORLD_TO_LIGHT for instancing)
+			// and Scene::ObjectUniforms (bound at ObjectBlockBinding), which draw() streams through a ring buffer:
+			GLuint Object_block = -1U; //uniform block index of the per-object block (-1U means use the uniform locations above)
+			enum : uint32_t { FrameBlockBinding = 0, ObjectBlockBinding = 1 };
+
 			//texture objects to bind for the first TextureCount textures:
 			enum : uint32_t { TextureCount = 4 };
+			enum : uint32_t { InstanceTextureUnit = TextureCount }; //(texture unit used for per-instance data)
+			enum : uint32_t { LightTextureUnit = TextureCount + 1, LightTileTextureUnit = TextureCount + 2 }; //(texture units used for lights; see Scene::LightGrid)
 			struct TextureInfo {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
@@ -116,17 +164,162 @@ struct Scene {
 		float spot_fov = glm::radians(45.0f); //spot cone fov (in radians)
 	};
 
+	//Uniform block layouts (std140; mat4x3 and mat3 columns are padded to vec4):
+	//per-frame data, written once per draw() call:
+	struct FrameUniforms {
+		glm::mat4 WORLD_TO_CLIP = glm::mat4(1.0f);
+		glm::vec4 WORLD_TO_LIGHT[4];
+		glm::ivec2 LIGHT_TILES = glm::ivec2(0); glm::ivec2 _pad = glm::ivec2(0); //size of the light tile grid (see LightGrid)
+	};
+	static_assert(sizeof(FrameUniforms) == 144, "FrameUniforms matches std140 layout.");
+	//per-drawable data:
+	struct ObjectUniforms {
+		glm::mat4 OBJECT_TO_CLIP;
+		glm::vec4 OBJECT_TO_LIGHT[4];
+		glm::vec4 NORMAL_TO_LIGHT[3];
+	};
+	static_assert(sizeof(ObjectUniforms) == 176, "ObjectUniforms matches std140 layout.");
+
 	//Scenes, of course, may have many of the above objects:
 	std::list< Transform > transforms;
 	std::list< Drawable > drawables;
 	std::list< Camera > cameras;
 	std::list< Light > lights;
 
+	//World matrices for all transforms, stored flat and in topological order (parents before children):
+	struct WorldCache {
+		std::vector< Transform const * > transforms;
+		std::vector< uint32_t > parents; //index of parent (or -1U if no parent)
+		std::vector< glm::mat4x3 > local_to_world;
+		std::vector< glm::mat4x3 > world_to_local;
+		std::vector< uint8_t > dirty; //set by Transform::mark_dirty(); cleared by update_world_matrices()
+		bool any_dirty = false; //(if set, cached matrices may be out of date)
+	};
+	mutable WorldCache world_cache;
+
+	//bring world_cache up to date in one pass, only recomputing matrices for transforms that (or whose ancestors) were marked dirty:
+	// (called by draw(); call it yourself if you are going to look up many world matrices)
+	// (transforms added to or removed from 'transforms' are noticed without being marked dirty)
+	void update_world_matrices() const;
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
-	void draw(Camera const &camera) const;
+	// (drawables whose bounds are entirely outside the view are skipped; the return value counts them)
+	// (drawables are sorted by program, vertex array, and texture, and only necessary state changes are made)
+	struct DrawStats {
+		uint32_t visible = 0; //drawables sent to OpenGL
+		uint32_t culled = 0; //drawables skipped because they were out of view
+		uint32_t program_changes = 0; //glUseProgram calls
+		uint32_t vao_changes = 0; //glBindVertexArray calls
+		uint32_t texture_changes = 0; //texture units re-bound
+		uint32_t draw_calls = 0; //glDraw* calls (including instanced draws and static batches' glMultiDrawArrays)
+		uint32_t instanced_draws = 0; //drawables drawn as part of instanced draw calls
+		uint32_t batched_draws = 0; //static drawables drawn as part of static batches
+		uint32_t gl_calls = 0; //OpenGL calls made by draw(), including first-use setup (not counting set_uniforms callbacks)
+		uint32_t lights = 0; //lights in view (zero when nothing drawn uses uniform blocks; see below)
+		uint32_t light_tile_entries = 0; //lights summed over all tiles (divide by tile count for lights per tile)
+	};
+	// (lights are sorted into a tile grid for shaders, see LightGrid; with no lights, a white hemisphere light shines down -z)
+	DrawStats draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
-	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+	DrawStats draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+
+	//Lighting:
+	// draw() sorts 'lights' into a grid of screen tiles on the CPU, so shaders only loop over the lights that reach each pixel:
+	//  (only when some pipeline it draws has an Object_block -- the lights, like the uniform blocks, are only for programs that use blocks)
+	//  - point and spot lights reach as far as their (inverse-square) falloff stays above LightCutoff;
+	//    shaders should window the falloff to zero at that range
+	//  - hemisphere and directional lights are in every tile
+	// shaders find lights in a samplerBuffer (RGBA32F) bound at LightTextureUnit, three texels per light:
+	//   (location.xyz, type) (direction.xyz, cosine of half the spot cone angle) (energy.rgb, range)
+	//   where type is 0: point, 1: hemisphere, 2: spot, 3: directional, and everything is in light space
+	// and the lights in each tile from a usamplerBuffer (R32UI) bound at LightTileTextureUnit:
+	//   tile t (= y * TilesX + x, counting from the bottom left of the view) has the light indices at [tiles[t], tiles[t+1])
+	struct LightGrid {
+		enum : uint32_t { TilesX = 16, TilesY = 16 };
+		std::vector< glm::vec4 > lights;
+		std::vector< uint32_t > tiles; //TilesX * TilesY + 1 offsets, followed by light indices
+
+		//scratch space used by cull_lights() (kept with the grid, so grids can be filled at the same time):
+		struct Cover {
+			uint32_t light;
+			glm::uvec2 min, max; //range of tiles covered by the light (inclusive)
+		};
+		std::vector< Cover > covers;
+		std::vector< uint32_t > next; //next free entry in each tile's list
+	};
+	static constexpr float LightCutoff = 1.0f / 256.0f;
+	//sort lights into tiles of the view given by world_to_clip (light space is assumed not to scale):
+	// (needs no OpenGL context; only touches 'grid', so different grids may be filled from different threads)
+	void cull_lights(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, LightGrid *grid) const;
+	mutable LightGrid light_grid; //(used by draw(); kept around so the storage can be reused)
+
+	//Static batching:
+	// build_static_batches() copies the triangles of drawables marked 'is_static' into world space,
+	// merging drawables with the same program and textures into one vertex buffer per batch.
+	// draw() culls each batched drawable separately and draws the visible ones in each batch with
+	// a single glMultiDrawArrays call.
+	//Only drawables that have a mesh_buffer loaded from "pnct" chunks (not quantized), draw triangles,
+	// and don't use set_uniforms are batched. Vertices are read from the mesh_buffer's CPU-side data, not from OpenGL.
+	//Call build_static_batches() again after changing static drawables; it needs the OpenGL context (to upload batches).
+	void build_static_batches();
+	void clear_static_batches();
+
+	struct StaticBatch {
+		StaticBatch() : drawable(&transform) { }
+		Transform transform; //(identity; batched vertices are already in world space)
+		Drawable drawable; //pipeline for drawing the batch, and bounds of all of its triangles
+		GLuint buffer = 0; //world-space vertices
+
+		//ranges of the buffer copied from each drawable, with world-space bounds:
+		struct Member {
+			GLint first = 0;
+			GLsizei count = 0;
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		};
+		std::vector< Member > members;
+
+		//ranges of visible members (adjacent ones merged), built by draw():
+		mutable std::vector< GLint > firsts;
+		mutable std::vector< GLsizei > counts;
+	};
+	std::list< StaticBatch > static_batches;
+
+	//(used by draw() to sort visible drawables; kept around so the storage can be reused)
+	struct DrawItem {
+		uint64_t key;
+		Drawable const *drawable;
+		glm::mat4x3 object_to_world;
+		StaticBatch const *batch; //(if not null, drawable is that batch's drawable)
+		uint32_t run; //(number of items drawn together with this one by instancing; 1 if not instanced)
+		GLintptr object_offset; //(offset of this item's ObjectUniforms in the uniform ring buffer, if used)
+	};
+	mutable std::vector< DrawItem > draw_queue;
+
+	//Look up transforms by name using an index:
+	// (index is built on first use, and rebuilt after transforms are added to or removed from 'transforms';
+	//  the index holds no copies of names, so a renamed transform is found under its new name once index_names() is called)
+	//the transform with a given name (or nullptr if there isn't one; the first in 'transforms' if there are several):
+	Transform *find_transform(std::string const &name);
+	//all transforms whose names start with 'prefix', sorted by name:
+	struct TransformSpan {
+		Transform * const *first = nullptr;
+		Transform * const *last = nullptr;
+		Transform * const *begin() const { return first; }
+		Transform * const *end() const { return last; }
+		size_t size() const { return last - first; }
+		bool empty() const { return first == last; }
+	};
+	TransformSpan find_transforms(std::string const &prefix);
+	//(re)build the index:
+	void index_names();
+
+	struct NameIndex {
+		std::vector< Transform * > by_name; //transforms sorted by name (ties in 'transforms' order)
+		std::vector< uint32_t > slots; //hash table (open addressing, power-of-two size) of the first index in by_name of each name; -1U if empty
+		size_t indexed_transforms = -1ULL; //transforms.size() when index was built (-1ULL if a transform has been destroyed since)
+	} name_index;
 
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
@@ -137,11 +330,15 @@ struct Scene {
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
-	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
+	// (use chunks.read(...) to get views of the chunks; they are only valid during the call)
+	virtual void load_extra(ChunkTable const &chunks, ChunkSpan< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
 
+	//(deletes static batches' OpenGL objects)
+	virtual ~Scene();
+
 	//load a scene:
 	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
 
@@ -110,6 +110,7 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 	;
 	scene_camera->transform->position = camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f));
 	scene_camera->transform->scale = glm::vec3(1.0f);
+	scene_camera->transform->mark_dirty();
 	scene_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 
@@ -161,13 +162,19 @@ void ShowMeshesMode::select_prev_mesh() {
 		scene_drawable->pipeline.type = f->second.type;
 		scene_drawable->pipeline.start = f->second.start;
 		scene_drawable->pipeline.count = f->second.count;
+		scene_drawable->pipeline.index_type = f->second.index_type;
+		scene_drawable->pipeline.position_to_object = f->second.position_to_object;
 		current_mesh_min = f->second.min;
 		current_mesh_max = f->second.max;
+		scene_drawable->min = f->second.min;
+		scene_drawable->max = f->second.max;
 	} else {
 		current_mesh_name = "";
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = GL_NONE;
+		scene_drawable->pipeline.position_to_object = glm::mat4x3(1.0f);
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
@@ -190,13 +197,19 @@ void ShowMeshesMode::select_next_mesh() {
 		scene_drawable->pipeline.type = f->second.type;
 		scene_drawable->pipeline.start = f->second.start;
 		scene_drawable->pipeline.count = f->second.count;
+		scene_drawable->pipeline.index_type = f->second.index_type;
+		scene_drawable->pipeline.position_to_object = f->second.position_to_object;
 		current_mesh_min = f->second.min;
 		current_mesh_max = f->second.max;
+		scene_drawable->min = f->second.min;
+		scene_drawable->max = f->second.max;
 	} else {
 		current_mesh_name = "";
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = GL_NONE;
+		scene_drawable->pipeline.position_to_object = glm::mat4x3(1.0f);
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
@@ -37,7 +37,7 @@ struct ShowMeshesMode : Mode {
 	void select_prev_mesh();
 	void select_next_mesh();
 	
-	//Vertex array object used to bind mesh buffer for drawing:
+	//Vertex array object used to bind mesh buffer for drawing (owned by the buffer):
 	GLuint vao = 0;
 
 	//mode uses a small Scene to arrange things for viewing:
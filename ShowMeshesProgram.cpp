@@ -15,7 +15,7 @@ Load< ShowMeshesProgram > show_meshes_program(LoadTagEarly, []() -> ShowMeshesPr
 	show_meshes_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
 
 	return ret;
-});
+}, LoadInfo{ "show_meshes_program" });
 
 ShowMeshesProgram::ShowMeshesProgram() {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
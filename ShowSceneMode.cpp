@@ -2,6 +2,7 @@
 #include "DrawLines.hpp"
 
 #include <iostream>
+#include <string>
 
 ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
 
@@ -81,6 +82,7 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	;
 	scene_camera->transform->position = camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f));
 	scene_camera->transform->scale = glm::vec3(1.0f);
+	scene_camera->transform->mark_dirty();
 	scene_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 
@@ -136,4 +138,23 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 		*/
 	}
 
+	{ //overlay what DrawLines streamed last frame:
+		glDisable(GL_DEPTH_TEST);
+		float aspect = float(drawable_size.x) / float(drawable_size.y);
+		DrawLines lines(glm::mat4(
+			1.0f / aspect, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		));
+
+		DrawLines::StreamStats const &stats = DrawLines::last_frame_stats;
+		constexpr float H = 0.06f;
+		lines.draw_text("lines: " + std::to_string(stats.bytes_streamed) + " bytes, "
+			+ std::to_string(stats.syncs) + " syncs, " + std::to_string(stats.stalls) + " stalls, "
+			+ std::to_string(stats.reallocations) + " reallocations",
+			glm::vec3(-aspect + 0.1f * H, -1.0f + 0.1f * H, 0.0f),
+			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+			glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+	}
 }
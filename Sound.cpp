@@ -4,11 +4,129 @@
 
 #include <SDL.h>
 
-#include <list>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SOUND_MIX_SSE
+#endif
+
+#include <array>
+#include <thread>
+#include <chrono>
+#include <limits>
 #include <cassert>
 #include <exception>
 #include <iostream>
+#include <fstream>
 #include <algorithm>
+#include <cstring>
+
+//Decodes a stream on a background thread into a ring buffer that the mixer reads from:
+struct Sound::Stream::Decoder {
+	Decoder(std::string const &filename) : reader(filename) {
+		thread = std::thread(&Decoder::run, this);
+	}
+	~Decoder() {
+		quit.store(true);
+		thread.join();
+	}
+
+	OpusReader reader; //(only used by the decoding thread once it starts)
+
+	static constexpr uint32_t const RingSize = 1 << 16; //about 1.4 seconds of audio
+	std::array< float, RingSize > ring;
+	std::atomic< uint32_t > write{0}; //next ring position to decode into (only modified by decoding thread)
+	std::atomic< uint32_t > read{0}; //next ring position to play (only modified by mixer)
+	std::atomic< uint32_t > discard_until{0}; //ring positions before this are from before the last seek, so skip them
+	std::atomic< bool > ended{false}; //reached end of file (and not looping), so nothing after 'write' is coming
+	std::atomic< bool > failed{false}; //decoding thread hit an error and stopped
+
+	//seeks are requested by storing a target and then bumping 'seek_requests':
+	std::atomic< int64_t > seek_target{0};
+	std::atomic< uint32_t > seek_requests{0};
+	std::atomic< uint32_t > seeks_done{0}; //(only modified by decoding thread)
+
+	std::atomic< bool > loop{false}; //should decoding wrap around at end of file?
+	std::atomic< bool > quit{false};
+	std::thread thread;
+
+	//(mixer) slot of the voice currently playing the stream:
+	uint32_t owner = -1U;
+	//(mixer) has the stream been played at all? (if not, it is already decoding from the start)
+	bool played = false;
+	//(mixer -> game thread) no voice refers to the stream any more, so it can be destroyed:
+	std::atomic< bool > released{false};
+
+	//(mixer) ask decoding thread to move to a new position; returns the request number to wait for:
+	uint32_t request_seek(int64_t sample) {
+		seek_target.store(sample, std::memory_order_relaxed);
+		return seek_requests.fetch_add(1, std::memory_order_release) + 1;
+	}
+
+	//(mixer) copy up to 'count' decoded samples into 'out'; returns number of samples copied:
+	uint32_t read_samples(float *out, uint32_t count) {
+		uint32_t r = read.load(std::memory_order_relaxed);
+		uint32_t d = discard_until.load(std::memory_order_acquire);
+		if (int32_t(d - r) > 0) r = d;
+		count = std::min(count, write.load(std::memory_order_acquire) - r);
+		for (uint32_t i = 0; i < count; ++i) {
+			out[i] = ring[(r + i) & (RingSize - 1)];
+		}
+		read.store(r + count, std::memory_order_release);
+		return count;
+	}
+
+	//(decoding thread) keep the ring topped up:
+	void run() {
+		try {
+			std::vector< float > chunk(4096);
+			uint32_t handled = 0; //seek requests handled so far
+			while (!quit.load(std::memory_order_relaxed)) {
+				uint32_t requested = seek_requests.load(std::memory_order_acquire);
+				if (requested != handled) {
+					reader.seek(seek_target.load(std::memory_order_relaxed));
+					//everything already decoded is from before the seek:
+					discard_until.store(write.load(std::memory_order_relaxed), std::memory_order_release);
+					ended.store(false, std::memory_order_relaxed);
+					handled = requested;
+					seeks_done.store(handled, std::memory_order_release);
+					continue;
+				}
+
+				//figure out how much space the mixer has left in the ring:
+				uint32_t w = write.load(std::memory_order_relaxed);
+				uint32_t r = read.load(std::memory_order_acquire);
+				uint32_t d = discard_until.load(std::memory_order_relaxed);
+				if (int32_t(d - r) > 0) r = d;
+				uint32_t space = RingSize - (w - r);
+
+				if (ended.load(std::memory_order_relaxed) || space < chunk.size()) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(5));
+					continue;
+				}
+
+				uint32_t count = reader.read(chunk.data(), uint32_t(chunk.size()));
+				if (count == 0) {
+					if (loop.load(std::memory_order_relaxed)) {
+						reader.seek(0);
+					} else {
+						ended.store(true, std::memory_order_release);
+					}
+					continue;
+				}
+				for (uint32_t i = 0; i < count; ++i) {
+					ring[(w + i) & (RingSize - 1)] = chunk[i];
+				}
+				write.store(w + count, std::memory_order_release);
+			}
+		} catch (std::exception &e) {
+			std::cerr << "Error decoding stream '" << reader.filename << "':\n" << e.what() << std::endl;
+			failed.store(true, std::memory_order_release);
+		}
+	}
+};
 
 //local (to this file) data used by the audio system:
 namespace {
@@ -19,10 +137,133 @@ namespace {
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
+	//(game thread) is the mixer run by render_offline() instead? (set by Sound::init_offline())
+	bool offline = false;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//Output buffer layout (interleaved stereo):
+	struct LR {
+		float l;
+		float r;
+	};
+	static_assert(sizeof(LR) == 8, "Sample is packed");
+
+	//Single-producer, single-consumer queue; neither push() nor pop() ever blocks:
+	// (push() should only be called from one thread, and pop() from one other thread)
+	template< typename T, uint32_t Size >
+	struct SPSCRing {
+		static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+		bool push(T const &item) {
+			uint32_t h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) == Size) return false; //full
+			items[h & (Size - 1)] = item;
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+		bool pop(T *item) {
+			uint32_t t = tail.load(std::memory_order_relaxed);
+			if (t == head.load(std::memory_order_acquire)) return false; //empty
+			*item = items[t & (Size - 1)];
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
 
+		std::array< T, Size > items;
+		std::atomic< uint32_t > head{0}; //next item to write (only modified by pushing thread)
+		std::atomic< uint32_t > tail{0}; //next item to read (only modified by popping thread)
+	};
+
+	//Commands sent from the game thread to the mixer:
+	struct Command {
+		enum Type : uint8_t {
+			Play, //start a voice in 'handle's slot; value is position, settings are in 'play'
+			SetVolume, //value.x is new volume
+			SetPan, //value.x is new pan
+			SetPosition, //value is new position
+			SetHalfVolumeRadius, //value.x is new radius
+			Stop, //fade 'handle's voice out over 'ramp'
+			Seek, //value.x is new time (in seconds)
+			StopAll, //stop all playing voices
+			SetPriority, //value.x is new priority
+			SetGlobalVolume, //value.x is new global volume
+			SetMaxVoices, //value.x is new maximum number of voices to mix
+			SetListener, //value is new listener position, right is new listener right
+			ReleaseStream, //drop every voice playing 'play.stream' (which is about to be destroyed)
+		} type = Play;
+		Sound::Handle handle;
+		float ramp = 0.0f;
+		glm::vec3 value = glm::vec3(0.0f);
+		glm::vec3 right = glm::vec3(0.0f);
+		struct {
+			std::vector< float > const *data = nullptr;
+			Sound::Stream::Decoder *stream = nullptr; //(nullptr if playing 'data')
+			float volume = 1.0f;
+			float pan = 0.0f; //(NaN for '3D' voices)
+			float half_volume_radius = 0.0f; //(NaN for '2D' voices)
+			bool loop = false;
+		} play;
+	};
+
+	//game thread -> mixer:
+	SPSCRing< Command, (1 << 15) > commands;
+
+	//The mixer's state for one playing sample:
+	struct Voice {
+		std::vector< float > const *data = nullptr; //sample data being played
+		uint32_t i = 0; //next data value to read
+		Sound::Stream::Decoder *stream = nullptr; //stream being played (if not playing 'data')
+		uint32_t wait_seek = 0; //don't read from stream until this seek request is done
+		bool loop = false; //should playback loop after data runs out?
+		bool stopping = false; //is playing stopping?
+		uint32_t slot = -1U; //slot (in the pool) that this voice occupies
+		float priority = 0.0f; //higher-priority voices are mixed first
+
+		//computed each mix_audio call:
+		LR start_pan, pan_step; //gain at start of block, and change per sample
+		float audibility = 0.0f; //loudest gain (in either channel) during block
+		bool real = false; //is voice mixed (rather than just advanced) this block?
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		Sound::Ramp< float > pan = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		//3D playback panning control: ('NaN' if sound played in 2D mode)
+		Sound::Ramp< glm::vec3 > position = Sound::Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
+		Sound::Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
+	};
+
+	//(mixer) playing voices, packed into voices[0] .. voices[voice_count-1]:
+	std::array< Voice, Sound::MaxVoices > voices;
+	uint32_t voice_count = 0;
+	//(mixer) index in 'voices' of the voice occupying each slot:
+	std::array< uint32_t, Sound::MaxVoices > slot_voices;
+
+	//current generation of each slot (only modified by the mixer, when a voice finishes):
+	std::array< std::atomic< uint32_t >, Sound::MaxVoices > slot_generations;
+
+	//mixer -> game thread, slots whose voices have finished playing:
+	SPSCRing< uint32_t, Sound::MaxVoices > freed_slots;
+
+	//(mixer) voices quieter than this (in both channels) aren't mixed -- about -60dB:
+	constexpr float const AUDIBILITY_THRESHOLD = 0.001f;
+	//(mixer) maximum number of voices to mix each block:
+	uint32_t max_voices = Sound::MaxVoices;
+	//(mixer) scratch space for picking which voices to mix:
+	std::array< uint32_t, Sound::MaxVoices > audible_voices;
+
+	//(mixer) decoded stream data for the current block:
+	std::array< float, MIX_SAMPLES > stream_buffer;
+
+	//(game thread) slots not used by any voice:
+	std::vector< uint32_t > free_slots = [](){
+		std::vector< uint32_t > slots;
+		slots.reserve(Sound::MaxVoices);
+		for (uint32_t s = Sound::MaxVoices; s > 0; --s) {
+			slots.emplace_back(s - 1);
+		}
+		return slots;
+	}();
 }
 
 //public-facing data:
@@ -33,9 +274,38 @@ Sound::Ramp< float > Sound::volume = Sound::Ramp< float >(1.0f);
 //global listener information:
 Sound::Listener Sound::listener;
 
+//mixer health counters:
+std::atomic< uint32_t > Sound::mix_overruns{0};
+std::atomic< uint32_t > Sound::dropped_commands{0};
+std::atomic< uint32_t > Sound::stream_underruns{0};
+std::atomic< uint32_t > Sound::virtual_voices{0};
+
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
 
+//Commands are applied by this function (defined below):
+void apply_command(Command const &command);
+
+//helper: hand a command to the mixer (or apply it directly if there is no mixer running):
+void push_command(Command const &command) {
+	if (!device) {
+		apply_command(command);
+		return;
+	}
+
+	while (!commands.push(command)) {
+		//queue is full -- only happens if the mixer has fallen very far behind.
+		if (command.type == Command::Play || command.type == Command::Stop || command.type == Command::StopAll || command.type == Command::ReleaseStream) {
+			//these can't be skipped, so wait for the mixer to catch up:
+			std::this_thread::yield();
+		} else {
+			//parameter changes will be superseded by later changes anyway, so skip:
+			Sound::dropped_commands.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+}
+
 //------------------------ public-facing --------------------------------
 
 Sound::Sample::Sample(std::string const &filename) {
@@ -51,6 +321,24 @@ Sound::Sample::Sample(std::string const &filename) {
 Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
 }
 
+Sound::Stream::Stream(std::string const &filename) {
+	if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus")) {
+		throw std::runtime_error("Stream '" + filename + "' doesn't end in \".opus\" -- only opus files can be streamed.");
+	}
+	decoder = std::make_unique< Decoder >(filename);
+}
+
+Sound::Stream::~Stream() {
+	//the mixer may still have voices reading from the decoder, so have it drop them and wait until it has:
+	Command command;
+	command.type = Command::ReleaseStream;
+	command.play.stream = decoder.get();
+	push_command(command);
+	while (!decoder->released.load(std::memory_order_acquire)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
 
 
 void Sound::init() {
@@ -99,110 +387,235 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
+void Sound::init_offline() {
+	if (device) {
+		throw std::runtime_error("Can't render audio offline while an audio device is open.");
+	}
+	offline = true;
+}
+
+void Sound::render_offline(uint32_t frames, float *buffer) {
+	init_offline();
+
+	//mixer works in whole blocks, so keep track of any extra from the last block:
+	static std::array< LR, MIX_SAMPLES > block;
+	static uint32_t block_used = MIX_SAMPLES; //samples of 'block' already returned
+
+	LR *out = reinterpret_cast< LR * >(buffer);
+	while (frames > 0) {
+		if (block_used == MIX_SAMPLES) {
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(block.data()), int(sizeof(block)));
+			block_used = 0;
+		}
+		uint32_t count = std::min(frames, MIX_SAMPLES - block_used);
+		std::memcpy(out, block.data() + block_used, count * sizeof(LR));
+		block_used += count;
+		out += count;
+		frames -= count;
+	}
+}
+
+void Sound::render_offline(uint32_t frames, std::string const &filename) {
+	std::vector< float > data(2 * size_t(frames));
+	render_offline(frames, data.data());
+
+	std::ofstream out(filename, std::ios::binary);
+	//helpers to write little-endian values:
+	auto write_u32 = [&out](uint32_t v) {
+		char bytes[4] = { char(v & 0xff), char((v >> 8) & 0xff), char((v >> 16) & 0xff), char((v >> 24) & 0xff) };
+		out.write(bytes, 4);
+	};
+	auto write_u16 = [&out](uint16_t v) {
+		char bytes[2] = { char(v & 0xff), char((v >> 8) & 0xff) };
+		out.write(bytes, 2);
+	};
+	static_assert(sizeof(float) == 4, "wav data is 32-bit float");
+	uint32_t data_bytes = uint32_t(data.size() * sizeof(float));
+
+	//(non-PCM formats need the extended 18-byte fmt chunk and a fact chunk)
+	out.write("RIFF", 4);
+	write_u32(4 + (8 + 18) + (8 + 4) + (8 + data_bytes));
+	out.write("WAVE", 4);
+
+	out.write("fmt ", 4);
+	write_u32(18);
+	write_u16(3); //WAVE_FORMAT_IEEE_FLOAT
+	write_u16(2); //channels
+	write_u32(AUDIO_RATE); //sample rate
+	write_u32(AUDIO_RATE * 2 * sizeof(float)); //bytes per second
+	write_u16(2 * sizeof(float)); //bytes per frame
+	write_u16(32); //bits per sample
+	write_u16(0); //size of extension
+
+	out.write("fact", 4);
+	write_u32(4);
+	write_u32(frames); //sample frames
+
+	out.write("data", 4);
+	write_u32(data_bytes);
+	for (float f : data) {
+		uint32_t bits;
+		std::memcpy(&bits, &f, 4);
+		write_u32(bits);
+	}
+
+	if (!out) {
+		throw std::runtime_error("Failed to write rendered audio to '" + filename + "'.");
+	}
+}
+
+//helper: start a sample playing:
+std::shared_ptr< Sound::PlayingSample > start_playing(std::vector< float > const *data, Sound::Stream::Decoder *stream, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool loop) {
+	//with no audio device (and no offline rendering) nothing mixes voices, so they would never finish and give back their slots:
+	if (!device && !offline) {
+		return std::make_shared< Sound::PlayingSample >(Sound::Handle());
+	}
+
+	//reclaim slots from voices the mixer has finished with:
+	uint32_t slot;
+	while (freed_slots.pop(&slot)) {
+		free_slots.emplace_back(slot);
+	}
+
+	if (free_slots.empty()) {
+		std::cerr << "WARNING: all " << Sound::MaxVoices << " voices are in use; not playing sample." << std::endl;
+		return std::make_shared< Sound::PlayingSample >(Sound::Handle());
+	}
+
+	Command command;
+	command.type = Command::Play;
+	command.handle.slot = free_slots.back();
+	command.handle.generation = slot_generations[command.handle.slot].load(std::memory_order_acquire);
+	free_slots.pop_back();
+	command.value = position;
+	command.play.data = data;
+	command.play.stream = stream;
+	command.play.volume = volume;
+	command.play.pan = pan;
+	command.play.half_volume_radius = half_volume_radius;
+	command.play.loop = loop;
+	push_command(command);
+
+	return std::make_shared< Sound::PlayingSample >(command.handle);
+}
+
 std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+	return start_playing(&sample.data, nullptr, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false);
 }
 
 std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+	return start_playing(&sample.data, nullptr, volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false);
 }
 
 std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+	return start_playing(&sample.data, nullptr, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), true);
 }
 
 
 
 std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+	return start_playing(&sample.data, nullptr, volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, true);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::play(Stream const &stream, float volume, float pan) {
+	return start_playing(nullptr, stream.decoder.get(), volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Stream const &stream, float volume, glm::vec3 const &position, float half_volume_radius) {
+	return start_playing(nullptr, stream.decoder.get(), volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::loop(Stream const &stream, float volume, float pan) {
+	return start_playing(nullptr, stream.decoder.get(), volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), true);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Stream const &stream, float volume, glm::vec3 const &position, float half_volume_radius) {
+	return start_playing(nullptr, stream.decoder.get(), volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, true);
 }
 
 
 void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
-	}
-	unlock();
+	Command command;
+	command.type = Command::StopAll;
+	command.ramp = 1.0f / 60.0f;
+	push_command(command);
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.value.x = new_volume;
+	command.ramp = ramp;
+	push_command(command);
+}
+
+void Sound::set_max_voices(uint32_t new_max_voices) {
+	Command command;
+	command.type = Command::SetMaxVoices;
+	command.value.x = float(std::min(new_max_voices, MaxVoices));
+	push_command(command);
 }
 
 //------------------
 
+//helper: queue a command that changes a playing sample:
+void push_sample_command(Command::Type type, Sound::PlayingSample *sample, glm::vec3 const &value, float ramp) {
+	if (sample->stopped()) return; //mixer is done with this sample
+	Command command;
+	command.type = type;
+	command.handle = sample->handle;
+	command.value = value;
+	command.ramp = ramp;
+	push_command(command);
+}
+
 void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
-	}
-	Sound::unlock();
+	push_sample_command(Command::SetVolume, this, glm::vec3(new_volume, 0.0f, 0.0f), ramp);
 }
 
 void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+	push_sample_command(Command::SetPan, this, glm::vec3(new_pan, 0.0f, 0.0f), ramp);
 }
 
 void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+	push_sample_command(Command::SetPosition, this, new_position, ramp);
 }
 
 void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+	push_sample_command(Command::SetHalfVolumeRadius, this, glm::vec3(new_radius, 0.0f, 0.0f), ramp);
 }
 
 void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	Sound::unlock();
+	push_sample_command(Command::Stop, this, glm::vec3(0.0f), ramp);
+}
+
+void Sound::PlayingSample::seek(float seconds) {
+	push_sample_command(Command::Seek, this, glm::vec3(seconds, 0.0f, 0.0f), 0.0f);
+}
+
+void Sound::PlayingSample::set_priority(float new_priority) {
+	push_sample_command(Command::SetPriority, this, glm::vec3(new_priority, 0.0f, 0.0f), 0.0f);
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (handle.slot >= MaxVoices) return true; //never got a voice
+	return slot_generations[handle.slot].load(std::memory_order_acquire) != handle.generation;
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+	Command command;
+	command.type = Command::SetListener;
+	command.value = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.right = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.right = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	command.ramp = ramp;
+	push_command(command);
 }
 
 //------------------------ internals --------------------------------
@@ -310,18 +723,183 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 }
 
 
+//helper: find the voice a handle refers to (or nullptr if the handle is stale):
+Voice *find_voice(Sound::Handle const &handle) {
+	if (handle.slot >= Sound::MaxVoices) return nullptr;
+	if (slot_generations[handle.slot].load(std::memory_order_relaxed) != handle.generation) return nullptr;
+	return &voices[slot_voices[handle.slot]];
+}
+
+//helper: stop a voice, fading out over 'ramp' seconds:
+void stop_voice(Voice &voice, float ramp) {
+	if (!voice.stopping) {
+		voice.stopping = true;
+		voice.volume.target = 0.0f;
+		voice.volume.ramp = ramp;
+	} else {
+		voice.volume.ramp = std::min(voice.volume.ramp, ramp);
+	}
+}
+
+//helper: apply a command from the game thread to the mixer's state:
+void apply_command(Command const &command) {
+	if (command.type == Command::Play) {
+		assert(voice_count < Sound::MaxVoices); //game thread only hands out free slots
+		Voice &voice = voices[voice_count];
+		voice.data = command.play.data;
+		voice.i = 0;
+		voice.stream = command.play.stream;
+		voice.wait_seek = 0;
+		if (voice.stream) {
+			//this voice takes over the stream (any earlier voice playing it will finish):
+			voice.stream->owner = command.handle.slot;
+			voice.stream->loop.store(command.play.loop);
+			//restart the stream (unless it is still decoding from the start, as it does before its first play):
+			if (voice.stream->played || voice.stream->ended.load()) {
+				voice.wait_seek = voice.stream->request_seek(0);
+			} else {
+				voice.wait_seek = voice.stream->seeks_done.load(std::memory_order_relaxed);
+			}
+			voice.stream->played = true;
+		}
+		voice.loop = command.play.loop;
+		voice.stopping = false;
+		voice.slot = command.handle.slot;
+		voice.priority = 0.0f;
+		voice.volume = Sound::Ramp< float >(command.play.volume);
+		voice.pan = Sound::Ramp< float >(command.play.pan);
+		voice.position = Sound::Ramp< glm::vec3 >(command.value);
+		voice.half_volume_radius = Sound::Ramp< float >(command.play.half_volume_radius);
+		slot_voices[voice.slot] = voice_count;
+		++voice_count;
+	} else if (command.type == Command::ReleaseStream) {
+		//(voices with no data finish -- without being mixed -- the next time they are visited)
+		static std::vector< float > const released_data;
+		for (uint32_t v = 0; v < voice_count; ++v) {
+			Voice &voice = voices[v];
+			if (voice.stream != command.play.stream) continue;
+			voice.stream = nullptr;
+			voice.data = &released_data;
+			voice.i = 0;
+		}
+		command.play.stream->released.store(true, std::memory_order_release);
+	} else if (command.type == Command::StopAll) {
+		for (uint32_t v = 0; v < voice_count; ++v) {
+			stop_voice(voices[v], command.ramp);
+		}
+	} else if (command.type == Command::SetGlobalVolume) {
+		Sound::volume.set(command.value.x, command.ramp);
+	} else if (command.type == Command::SetMaxVoices) {
+		max_voices = uint32_t(command.value.x);
+	} else if (command.type == Command::SetListener) {
+		Sound::listener.position.set(command.value, command.ramp);
+		Sound::listener.right.set(command.right, command.ramp);
+	} else {
+		Voice *voice = find_voice(command.handle);
+		if (!voice) return; //voice already finished
+
+		if (command.type == Command::SetVolume) {
+			if (!voice->stopping) {
+				voice->volume.set(command.value.x, command.ramp);
+			}
+		} else if (command.type == Command::SetPan) {
+			if (!(voice->pan.value == voice->pan.value)) return; //ignore if not in '2D' mode
+			voice->pan.set(command.value.x, command.ramp);
+		} else if (command.type == Command::SetPosition) {
+			if (voice->pan.value == voice->pan.value) return; //ignore if not in '3D' mode
+			voice->position.set(command.value, command.ramp);
+		} else if (command.type == Command::SetHalfVolumeRadius) {
+			if (voice->pan.value == voice->pan.value) return; //ignore if not in '3D' mode
+			voice->half_volume_radius.set(command.value.x, command.ramp);
+		} else if (command.type == Command::Stop) {
+			stop_voice(*voice, command.ramp);
+		} else if (command.type == Command::SetPriority) {
+			voice->priority = command.value.x;
+		} else if (command.type == Command::Seek) {
+			int64_t sample = int64_t(std::max(0.0f, command.value.x) * float(AUDIO_RATE));
+			if (voice->stream) {
+				if (voice->stream->owner == voice->slot) {
+					voice->wait_seek = voice->stream->request_seek(sample);
+				}
+			} else {
+				voice->i = uint32_t(std::min< int64_t >(sample, int64_t(voice->data->size())));
+			}
+		} else {
+			assert(0 && "unknown command type");
+		}
+	}
+}
+
+//helper: mix a run of mono samples into the (stereo) output buffer,
+// with pan ramping linearly from 'pan' by 'pan_step' per sample:
+void mix_run(LR *buffer, float const *data, uint32_t count, LR pan, LR pan_step) {
+	uint32_t i = 0;
+
+#if defined(__AVX__)
+	{ //eight samples at a time:
+		//(pan is computed from the sample index, as below, so rounding doesn't accumulate over long runs)
+		__m256 base = _mm256_setr_ps(pan.l, pan.r, pan.l, pan.r, pan.l, pan.r, pan.l, pan.r);
+		__m256 step = _mm256_setr_ps(pan_step.l, pan_step.r, pan_step.l, pan_step.r, pan_step.l, pan_step.r, pan_step.l, pan_step.r);
+		//index offsets for samples 0-3 and 4-7:
+		__m256 offset_lo = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+		__m256 offset_hi = _mm256_setr_ps(4.0f, 4.0f, 5.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f);
+		for (; i + 8 <= count; i += 8) {
+			__m256 at = _mm256_set1_ps(float(i));
+			__m256 pan_lo = _mm256_add_ps(base, _mm256_mul_ps(_mm256_add_ps(at, offset_lo), step));
+			__m256 pan_hi = _mm256_add_ps(base, _mm256_mul_ps(_mm256_add_ps(at, offset_hi), step));
+			__m256 s = _mm256_loadu_ps(data + i); //s0 .. s7
+			__m256 a = _mm256_unpacklo_ps(s, s); //s0 s0 s1 s1 | s4 s4 s5 s5
+			__m256 b = _mm256_unpackhi_ps(s, s); //s2 s2 s3 s3 | s6 s6 s7 s7
+			float *out = &buffer[i].l;
+			_mm256_storeu_ps(out, _mm256_add_ps(_mm256_loadu_ps(out), _mm256_mul_ps(_mm256_permute2f128_ps(a, b, 0x20), pan_lo)));
+			_mm256_storeu_ps(out + 8, _mm256_add_ps(_mm256_loadu_ps(out + 8), _mm256_mul_ps(_mm256_permute2f128_ps(a, b, 0x31), pan_hi)));
+		}
+	}
+#endif
+
+#if defined(SOUND_MIX_SSE)
+	{ //four samples at a time:
+		__m128 base = _mm_setr_ps(pan.l, pan.r, pan.l, pan.r);
+		__m128 step = _mm_setr_ps(pan_step.l, pan_step.r, pan_step.l, pan_step.r);
+		//index offsets for samples 0,1 and 2,3:
+		__m128 offset_lo = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+		__m128 offset_hi = _mm_setr_ps(2.0f, 2.0f, 3.0f, 3.0f);
+		for (; i + 4 <= count; i += 4) {
+			__m128 at = _mm_set1_ps(float(i));
+			__m128 pan_lo = _mm_add_ps(base, _mm_mul_ps(_mm_add_ps(at, offset_lo), step));
+			__m128 pan_hi = _mm_add_ps(base, _mm_mul_ps(_mm_add_ps(at, offset_hi), step));
+			__m128 s = _mm_loadu_ps(data + i); //s0 s1 s2 s3
+			float *out = &buffer[i].l;
+			_mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(_mm_unpacklo_ps(s, s), pan_lo)));
+			_mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(_mm_unpackhi_ps(s, s), pan_hi)));
+		}
+	}
+#endif
+
+	//whatever is left (or everything, if no SIMD is available), one sample at a time:
+	for (; i < count; ++i) {
+		buffer[i].l += (pan.l + float(i) * pan_step.l) * data[i];
+		buffer[i].r += (pan.r + float(i) * pan_step.r) * data[i];
+	}
+}
+
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(buffer_); //should always have some audio buffer
 
-	struct LR {
-		float l;
-		float r;
-	};
-	static_assert(sizeof(LR) == 8, "Sample is packed");
 	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
+	Uint64 mix_start = SDL_GetPerformanceCounter();
+
+	//apply any changes queued by the game thread:
+	{
+		Command command;
+		while (commands.pop(&command)) {
+			apply_command(command);
+		}
+	}
+
 	//zero the output buffer:
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		buffer[s].l = 0.0f;
@@ -341,96 +919,172 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	glm::vec3 end_position =  Sound::listener.position.value;
 	glm::vec3 end_right =  Sound::listener.right.value;
 
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	//figure out how loud each voice will be over this block:
+	uint32_t audible_count = 0;
+	for (uint32_t v = 0; v < voice_count; ++v) {
+		Voice &voice = voices[v]; //much more convenient than writing voices[v] everywhere.
 
 		//Figure out sample panning/volume at start...
-		LR start_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+		LR &start_pan = voice.start_pan;
+		if (!(voice.pan.value == voice.pan.value)) {
 			//3D panning
 			compute_pan_from_listener_and_position(
 				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
+				voice.position.value,
+				voice.half_volume_radius.value,
 				&start_pan.l, &start_pan.r);
 
-			step_position_ramp(playing_sample.position);
-			step_value_ramp(playing_sample.half_volume_radius);
+			step_position_ramp(voice.position);
+			step_value_ramp(voice.half_volume_radius);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+			compute_pan_weights(voice.pan.value, &start_pan.l, &start_pan.r);
 
-			step_value_ramp(playing_sample.pan);
+			step_value_ramp(voice.pan);
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
+		start_pan.l *= start_volume * voice.volume.value;
+		start_pan.r *= start_volume * voice.volume.value;
 
-		step_value_ramp(playing_sample.volume);
+		step_value_ramp(voice.volume);
 
 		//..and end of the mix period:
 		LR end_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+		if (!(voice.pan.value == voice.pan.value)) {
 			//3D panning
 			compute_pan_from_listener_and_position(
 				end_position, end_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
+				voice.position.value,
+				voice.half_volume_radius.value,
 				&end_pan.l, &end_pan.r);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			compute_pan_weights(voice.pan.value, &end_pan.l, &end_pan.r);
 		}
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+		end_pan.l *= end_volume * voice.volume.value;
+		end_pan.r *= end_volume * voice.volume.value;
 
 		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
-
-		assert(playing_sample.i < playing_sample.data.size());
-
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
-
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
-				} else {
-					break;
+		voice.pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
+		voice.pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
+
+		//gain is linear over the block, so the loudest point is at one end or the other:
+		voice.audibility = std::max(
+			std::max(std::abs(start_pan.l), std::abs(start_pan.r)),
+			std::max(std::abs(end_pan.l), std::abs(end_pan.r))
+		);
+		voice.real = false;
+		if (voice.audibility >= AUDIBILITY_THRESHOLD) {
+			audible_voices[audible_count++] = v;
+		}
+	}
+
+	//if there are too many audible voices, only mix the most important:
+	if (audible_count > max_voices) {
+		std::nth_element(audible_voices.begin(), audible_voices.begin() + max_voices, audible_voices.begin() + audible_count,
+			[](uint32_t a, uint32_t b) {
+				if (voices[a].priority != voices[b].priority) return voices[a].priority > voices[b].priority;
+				return voices[a].audibility > voices[b].audibility;
+			}
+		);
+		audible_count = max_voices;
+	}
+	for (uint32_t a = 0; a < audible_count; ++a) {
+		voices[audible_voices[a]].real = true;
+	}
+	Sound::virtual_voices.store(voice_count - audible_count, std::memory_order_relaxed);
+
+	//add audio from each real voice into the buffer (and advance virtual voices without mixing them):
+	for (uint32_t v = 0; v < voice_count; /* later */) {
+		Voice &voice = voices[v];
+		LR const &start_pan = voice.start_pan;
+		LR const &pan_step = voice.pan_step;
+
+		bool finished = false;
+		if (voice.stream) {
+			//mix whatever the stream's decoder has ready:
+			Sound::Stream::Decoder &stream = *voice.stream;
+			uint32_t count = 0;
+			if (stream.owner != voice.slot || stream.failed.load(std::memory_order_acquire)) {
+				//stream was taken over by another voice (or can't be decoded):
+				finished = true;
+			} else if (int32_t(stream.seeks_done.load(std::memory_order_acquire) - voice.wait_seek) >= 0) {
+				count = stream.read_samples(stream_buffer.data(), MIX_SAMPLES);
+				if (count < MIX_SAMPLES) {
+					if (stream.ended.load(std::memory_order_acquire)
+					 && stream.read.load(std::memory_order_relaxed) == stream.write.load(std::memory_order_relaxed)) {
+						finished = true;
+					} else {
+						Sound::stream_underruns.fetch_add(1, std::memory_order_relaxed);
+					}
 				}
 			}
+			if (voice.real) mix_run(buffer, stream_buffer.data(), count, start_pan, pan_step);
+		} else {
+			std::vector< float > const &data = *voice.data;
+
+			//(empty samples don't have anything to mix)
+			uint32_t mix_samples = (voice.i < data.size() ? MIX_SAMPLES : 0);
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+			//mix whole runs of samples, up to the end of the data each time:
+			for (uint32_t mixed = 0; mixed < mix_samples; /* later */) {
+				uint32_t run = std::min(mix_samples - mixed, uint32_t(data.size()) - voice.i);
+
+				if (voice.real) {
+					LR run_pan;
+					run_pan.l = start_pan.l + float(mixed) * pan_step.l;
+					run_pan.r = start_pan.r + float(mixed) * pan_step.r;
+					mix_run(buffer + mixed, data.data() + voice.i, run, run_pan, pan_step);
+				}
+
+				//update position in sample:
+				mixed += run;
+				voice.i += run;
+				if (voice.i == data.size()) {
+					if (voice.loop) {
+						voice.i = 0;
+					} else {
+						break;
+					}
+				}
+			}
+
+			finished = (voice.i >= data.size());
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+		if (finished || (voice.stopping && voice.volume.value == 0.0f)) { //sample has finished
+			//release the stream (if this voice still holds it):
+			if (voice.stream && voice.stream->owner == voice.slot) voice.stream->owner = -1U;
+
+			//make any handles to this voice stale, and give the slot back to the game thread:
+			uint32_t slot = voice.slot;
+			slot_generations[slot].store(slot_generations[slot].load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			bool pushed = freed_slots.push(slot);
+			assert(pushed && "freed_slots can hold every slot");
+			(void)pushed;
+
+			//erase from array (order doesn't matter, so move last voice here):
+			--voice_count;
+			if (v != voice_count) {
+				voice = voices[voice_count];
+				slot_voices[voice.slot] = v;
+			}
 		} else {
-			++si;
+			++v;
 		}
 	}
 
+	//keep track of callbacks that couldn't keep up with playback:
+	if (SDL_GetPerformanceCounter() - mix_start > SDL_GetPerformanceFrequency() * MIX_SAMPLES / AUDIO_RATE) {
+		Sound::mix_overruns.fetch_add(1, std::memory_order_relaxed);
+	}
+
 	/*//DEBUG: report output power:
 	float max_power = 0.0f;
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
+	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing voices: " << voice_count << std::endl; //DEBUG
 	*/
 
 }
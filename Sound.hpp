@@ -6,6 +6,7 @@
 #include <vector>
 #include <string>
 #include <cmath>
+#include <atomic>
 
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
@@ -25,6 +26,21 @@ struct Sample {
 	std::vector< float > data;
 };
 
+//Stream objects play long '.opus' files (e.g., music) without decoding them all up front:
+// the file is kept open and decoded a little ahead of playback by a background thread.
+//A stream can only be heard once at a time; playing it again restarts it (and ends the earlier playback).
+struct Stream {
+	//Open an '.opus' file for streaming; throws on error:
+	Stream(std::string const &filename);
+	//Stops any playback of the stream; waits (about one mix block) for the mixer to let go of it,
+	// so don't destroy a stream while holding Sound::lock():
+	~Stream();
+
+	//internals:
+	struct Decoder; //(defined in Sound.cpp)
+	std::unique_ptr< Decoder > decoder;
+};
+
 //Ramp<> manages values that should be smoothly interpolated
 //  to a target over a certain amount of time:
 template< typename T >
@@ -48,9 +64,18 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+//Voices are the mixer's copies of playing samples; they live in a fixed-size pool.
+//Handles refer to a slot in that pool; each time a slot is freed its generation is bumped,
+// so handles to voices that have finished become "stale" (and commands sent through them are ignored):
+constexpr uint32_t const MaxVoices = 4096;
+struct Handle {
+	uint32_t slot = -1U; //(-1U if no slot was available)
+	uint32_t generation = 0;
+};
+
+// 'PlayingSample' objects are handles to samples that are currently playing:
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample (by queuing a command for the mixer);
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
 	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
@@ -63,28 +88,22 @@ struct PlayingSample {
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
 	void stop(float ramp = 1.0f / 60.0f);
 
+	//jump to a given time (in seconds) in the sample or stream:
+	void seek(float seconds);
+
+	//when there are more audible samples than the voice limit (see set_max_voices()),
+	// higher-priority samples are mixed first (default priority is 0):
+	void set_priority(float new_priority);
+
+	//was playback stopped (either by running out of sample, or by stop())?
+	bool stopped() const;
+
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	//NOTE: the sample's playback state is owned by the mixer (see 'Voice' in Sound.cpp);
+	// this is just a handle to it.
+	Handle handle;
+
+	PlayingSample(Handle const &handle_) : handle(handle_) { }
 };
 
 // ------- global functions -------
@@ -123,6 +142,12 @@ std::shared_ptr< PlayingSample > loop_3D(
 	float half_volume_radius = std::numeric_limits< float >::infinity()
 );
 
+//Streams can be played / looped the same way as samples:
+std::shared_ptr< PlayingSample > play(Stream const &stream, float volume = 1.0f, float pan = 0.0f);
+std::shared_ptr< PlayingSample > play_3D(Stream const &stream, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity());
+std::shared_ptr< PlayingSample > loop(Stream const &stream, float volume = 1.0f, float pan = 0.0f);
+std::shared_ptr< PlayingSample > loop_3D(Stream const &stream, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity());
+
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
@@ -140,10 +165,31 @@ void stop_all_samples();
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
+//limit the number of samples that are actually mixed:
+// samples beyond the limit (lowest priority, then quietest first) -- and all samples too quiet to hear --
+// become "virtual": they keep advancing through their data, but aren't mixed until they are audible again.
+void set_max_voices(uint32_t max_voices); //(default is MaxVoices, i.e., only inaudible samples are skipped)
+
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// the set_*/stop/play/... functions don't need these helpers (they send commands to the mixer
+// through a lock-free queue), so you shouldn't need to call them unless your code is modifying values directly:
 void lock();
 void unlock();
 
+//offline rendering runs the mixer without an audio device, as fast as possible (e.g., for benchmarks or tests);
+// only allowed when no audio device is open (Sound::init() wasn't called or couldn't open one), throws otherwise.
+//without a device, samples only start playing after init_offline() (or a first render_offline()) -- otherwise play() returns a stopped handle.
+//consecutive calls continue seamlessly from each other.
+void init_offline();
+//write 'frames' interleaved stereo (left, right) samples to 'buffer':
+void render_offline(uint32_t frames, float *buffer);
+//...or to a 48kHz stereo 32-bit float '.wav' file:
+void render_offline(uint32_t frames, std::string const &filename);
+
+//counters for checking on the health of the mixer (e.g., when stress-testing):
+extern std::atomic< uint32_t > mix_overruns; //number of mix_audio calls that took longer than the audio they produced
+extern std::atomic< uint32_t > dropped_commands; //number of parameter changes dropped because the command queue was full
+extern std::atomic< uint32_t > stream_underruns; //number of mix_audio calls where a stream's decoder hadn't kept up
+extern std::atomic< uint32_t > virtual_voices; //number of voices that weren't mixed in the most recent mix_audio call
+
 } //namespace Sound
@@ -0,0 +1,104 @@
+/*
+ * bench-chunk-compress measures compressed chunks (see ChunkCompressedBit in read_write_chunk.hpp) on a chunk file:
+ *  - compresses every chunk (in memory) and reports the size before and after
+ *  - times reading the file with and without compression (read_chunk over in-memory copies, so disk speed doesn't matter)
+ *  - checks that decompressed chunks match the originals
+ *
+ * Usage:
+ *   bench-chunk-compress [file.pnct|file.scene [block-KB [repeats]]]
+ *  (default file is dist/playground.pnct; default block size is 1024 KB)
+ *
+ * Compressed loads only pay off when storage is slower than the decode rate printed here.
+ */
+
+#include "read_write_chunk.hpp"
+#include "mapped_file.hpp"
+#include "data_path.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+	std::string filename = (argc > 1 ? argv[1] : data_path("../dist/playground.pnct"));
+	uint32_t block_size = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 1024) * 1024;
+	uint32_t repeats = (argc > 3 ? uint32_t(std::stoul(argv[3])) : 5);
+
+	//copy every chunk into a plain and a compressed version of the file:
+	std::vector< std::string > magics;
+	std::string plain, compressed;
+	size_t uncompressed_bytes = 0;
+	{
+		MappedFile file(filename);
+		ChunkTable table(file.begin(), file.end());
+		ChunkWriter plain_writer, compressed_writer;
+		for (auto const &entry : table.entries) {
+			std::string magic(entry.magic, 4);
+			ChunkSpan< char > data;
+			table.read(magic, &data);
+			std::vector< char > bytes(data.begin(), data.end());
+			plain_writer.add(magic, bytes);
+			compressed_writer.chunks.emplace_back();
+			compressed_writer.chunks.back().magic = magic;
+			compressed_writer.chunks.back().compressed = true;
+			compressed_writer.chunks.back().data = compress_chunk(bytes.data(), bytes.size(), block_size);
+			magics.emplace_back(magic);
+			uncompressed_bytes += bytes.size();
+		}
+		std::ostringstream plain_out, compressed_out;
+		plain_writer.write(&plain_out, false);
+		compressed_writer.write(&compressed_out, false);
+		plain = plain_out.str();
+		compressed = compressed_out.str();
+	}
+
+	auto now = []() { return std::chrono::high_resolution_clock::now(); };
+	auto ms = [](auto before, auto after) { return std::chrono::duration< double, std::milli >(after - before).count(); };
+
+	//read every chunk of an in-memory file; returns a sum of the bytes:
+	auto read_all = [&magics](std::string const &file) {
+		uint64_t sum = 0;
+		ChunkCursor cursor(file.data(), file.data() + file.size());
+		for (auto const &magic : magics) {
+			ChunkSpan< char > data;
+			read_chunk(&cursor, magic, &data);
+			for (char c : data) sum += uint8_t(c);
+		}
+		return sum;
+	};
+
+	uint64_t plain_sum = 0, compressed_sum = 0;
+	auto before = now();
+	for (uint32_t r = 0; r < repeats; ++r) plain_sum = read_all(plain);
+	double plain_ms = ms(before, now()) / repeats;
+
+	before = now();
+	for (uint32_t r = 0; r < repeats; ++r) compressed_sum = read_all(compressed);
+	double compressed_ms = ms(before, now()) / repeats;
+
+	//check that decompressed bytes match exactly:
+	bool match = true;
+	{
+		ChunkCursor a(plain.data(), plain.data() + plain.size());
+		ChunkCursor b(compressed.data(), compressed.data() + compressed.size());
+		for (auto const &magic : magics) {
+			ChunkSpan< char > x, y;
+			read_chunk(&a, magic, &x);
+			read_chunk(&b, magic, &y);
+			if (x.size() != y.size() || (x.size() != 0 && std::memcmp(x.data(), y.data(), x.size()) != 0)) match = false;
+		}
+	}
+
+	double mb = uncompressed_bytes / (1024.0 * 1024.0);
+	std::cout << filename << " (" << magics.size() << " chunks), " << (block_size / 1024) << " KB blocks, " << std::thread::hardware_concurrency() << " hardware threads:\n";
+	std::cout << "  size: " << plain.size() << " -> " << compressed.size() << " bytes (" << (100.0 * compressed.size() / plain.size()) << "%)\n";
+	std::cout << "  uncompressed read: " << plain_ms << " ms\n";
+	std::cout << "  compressed read: " << compressed_ms << " ms (" << (mb / compressed_ms * 1000.0) << " MB/s of output)\n";
+	std::cout << "  decompressed data " << (match && plain_sum == compressed_sum ? "matches" : "DIFFERS") << std::endl;
+
+	return (match && plain_sum == compressed_sum ? 0 : 1);
+}
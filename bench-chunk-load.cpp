@@ -0,0 +1,210 @@
+/*
+ * bench-chunk-load compares the two ways of reading a chunk file (see read_write_chunk.hpp):
+ *  - read_chunk(std::istream &, ...), which copies each chunk into a vector
+ *  - read_chunk(ChunkCursor *, ...) over a MappedFile, which views each chunk in place
+ *  both versions touch every byte of every chunk, and the sums are checked against each other.
+ *
+ * Each version runs in its own process (this program runs itself with --run), so that the
+ *  peak resident set size reported for it (getrusage's ru_maxrss) only counts its own loads.
+ *
+ * Usage:
+ *   bench-chunk-load [file.pnct|file.scene [repeats]]
+ *  (default file is dist/playground.pnct)
+ *   bench-chunk-load --generate out.pnct [MB]
+ *  writes a synthetic .pnct file of about MB megabytes (default 500) to compare on.
+ *   bench-chunk-load --run stream|mapped file.pnct repeats
+ *  (used internally) loads the file one way and prints "ms sum peak-RSS-MB".
+ */
+
+#include "read_write_chunk.hpp"
+#include "mapped_file.hpp"
+#include "data_path.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+//peak resident set size of this process, in MB (or -1 where that isn't measured):
+static double peak_rss_mb() {
+#ifdef _WIN32
+	return -1.0;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	#ifdef __APPLE__
+	return usage.ru_maxrss / (1024.0 * 1024.0); //(bytes on macOS)
+	#else
+	return usage.ru_maxrss / 1024.0; //(kilobytes on Linux)
+	#endif
+#endif
+}
+
+//write a .pnct file with about 'mb' megabytes of vertices, split into meshes of (at most) 30000 vertices:
+static void generate(std::string const &filename, uint32_t mb) {
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+	constexpr uint32_t MeshVertices = 30000;
+
+	std::vector< Vertex > vertices(size_t(mb) * 1024 * 1024 / sizeof(Vertex) / 3 * 3); //(whole triangles)
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		float f = float(i % 1000);
+		vertices[i].Position = glm::vec3(f, 0.5f * f, 0.25f * f);
+		vertices[i].Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+		vertices[i].Color = glm::u8vec4(uint8_t(i), uint8_t(i >> 8), uint8_t(i >> 16), 0xff);
+		vertices[i].TexCoord = glm::vec2(f / 1000.0f, 1.0f - f / 1000.0f);
+	}
+
+	std::vector< char > strings;
+	std::vector< IndexEntry > index;
+	for (size_t begin = 0; begin < vertices.size(); begin += MeshVertices) {
+		std::string name = "Synthetic." + std::to_string(index.size());
+		IndexEntry entry;
+		entry.name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), name.begin(), name.end());
+		entry.name_end = uint32_t(strings.size());
+		entry.vertex_begin = uint32_t(begin);
+		entry.vertex_end = uint32_t(std::min(begin + MeshVertices, vertices.size()));
+		index.emplace_back(entry);
+	}
+
+	std::ofstream out(filename, std::ios::binary);
+	write_chunk("pnct", vertices, &out);
+	write_chunk("str0", strings, &out);
+	write_chunk("idx0", index, &out);
+	if (!out) throw std::runtime_error("failed to write '" + filename + "'");
+	std::cout << "wrote " << filename << " (" << vertices.size() << " vertices in " << index.size() << " meshes)" << std::endl;
+}
+
+//load every chunk of a file 'repeats' times, the way 'path' says; prints "ms sum peak-RSS-MB":
+static void run(std::string const &path, std::string const &filename, uint32_t repeats) {
+	//magic of each chunk, in file order:
+	std::vector< std::string > magics;
+	{
+		MappedFile file(filename);
+		ChunkTable table(file.begin(), file.end());
+		//(the table of contents isn't one of its own entries, but the istream version still has to read past it)
+		if (file.size >= 4 && std::memcmp(file.data, "toc0", 4) == 0) magics.emplace_back("toc0");
+		for (auto const &entry : table.entries) {
+			magics.emplace_back(entry.magic, 4);
+		}
+	}
+
+	uint64_t sum = 0;
+	auto before = std::chrono::high_resolution_clock::now();
+	for (uint32_t r = 0; r < repeats; ++r) {
+		if (path == "stream") {
+			std::ifstream file(filename, std::ios::binary);
+			std::vector< char > data;
+			for (auto const &magic : magics) {
+				read_chunk(file, magic, &data);
+				for (char c : data) sum += uint8_t(c);
+			}
+		} else if (path == "mapped") {
+			MappedFile file(filename);
+			ChunkCursor cursor(file.begin(), file.end());
+			for (auto const &magic : magics) {
+				ChunkSpan< char > data;
+				read_chunk(&cursor, magic, &data);
+				for (char c : data) sum += uint8_t(c);
+			}
+		} else {
+			throw std::runtime_error("unknown load path '" + path + "'");
+		}
+	}
+	double ms = std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - before).count() / repeats;
+
+	std::cout << ms << " " << sum << " " << peak_rss_mb() << std::endl;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && std::string(argv[1]) == "--generate") {
+		if (argc < 3) {
+			std::cerr << "Usage:\n\t" << argv[0] << " --generate out.pnct [MB]" << std::endl;
+			return 1;
+		}
+		generate(argv[2], (argc > 3 ? uint32_t(std::stoul(argv[3])) : 500));
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--run") {
+		if (argc != 5) {
+			std::cerr << "Usage:\n\t" << argv[0] << " --run stream|mapped file repeats" << std::endl;
+			return 1;
+		}
+		run(argv[2], argv[3], uint32_t(std::stoul(argv[4])));
+		return 0;
+	}
+
+	std::string filename = (argc > 1 ? argv[1] : data_path("../dist/playground.pnct"));
+	uint32_t repeats = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 20);
+
+	size_t file_size = 0;
+	{
+		MappedFile file(filename);
+		file_size = file.size;
+	}
+	double mb = file_size / (1024.0 * 1024.0);
+
+	//run each version in its own process:
+	struct Result {
+		double ms = 0.0;
+		uint64_t sum = 0;
+		double rss = -1.0;
+	};
+	auto run_child = [&](std::string const &path) {
+		std::string command = "\"" + std::string(argv[0]) + "\" --run " + path + " \"" + filename + "\" " + std::to_string(repeats);
+		#ifdef _WIN32
+		FILE *child = _popen(("\"" + command + "\"").c_str(), "r"); //(cmd.exe strips one set of outer quotes)
+		#else
+		FILE *child = popen(command.c_str(), "r");
+		#endif
+		if (!child) throw std::runtime_error("failed to run '" + command + "'");
+		std::string output;
+		char buffer[256];
+		while (std::fgets(buffer, sizeof(buffer), child)) output += buffer;
+		#ifdef _WIN32
+		int status = _pclose(child);
+		#else
+		int status = pclose(child);
+		#endif
+		Result result;
+		std::istringstream in(output);
+		if (status != 0 || !(in >> result.ms >> result.sum >> result.rss)) {
+			throw std::runtime_error("'" + command + "' failed (output: '" + output + "')");
+		}
+		return result;
+	};
+	Result stream = run_child("stream");
+	Result mapped = run_child("mapped");
+
+	auto rss = [](double rss) {
+		return (rss < 0.0 ? std::string("not measured") : std::to_string(rss) + " MB");
+	};
+	std::cout << filename << " (" << mb << " MB), average of " << repeats << " loads, each version in its own process:\n";
+	std::cout << "  istream read_chunk: " << stream.ms << " ms (" << (mb / stream.ms * 1000.0) << " MB/s), peak RSS " << rss(stream.rss) << "\n";
+	std::cout << "  mapped read_chunk: " << mapped.ms << " ms (" << (mb / mapped.ms * 1000.0) << " MB/s), peak RSS " << rss(mapped.rss) << "\n";
+	std::cout << "  sums " << (stream.sum == mapped.sum ? "match" : "DIFFER") << std::endl;
+
+	return (stream.sum == mapped.sum ? 0 : 1);
+}
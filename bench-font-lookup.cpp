@@ -0,0 +1,68 @@
+/*
+ * bench-font-lookup times PathFont glyph lookup for a string, two ways:
+ *  - the old DrawLines::draw_text approach: growing substrings looked up in PathFont::glyph_map
+ *  - PathFont::match(), which walks the generated byte trie
+ *  and checks that both find the same glyphs.
+ *
+ * Usage:
+ *   bench-font-lookup [repeats ["text"]]
+ */
+
+#include "PathFont.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t repeats = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 200000);
+	std::string text = (argc > 2 ? argv[2] : "Mouse motion rotates camera; WASD moves; escape ungrabs mouse");
+
+	PathFont const &font = PathFont::font;
+
+	auto now = []() { return std::chrono::high_resolution_clock::now(); };
+	auto seconds = [](auto before, auto after) { return std::chrono::duration< double >(after - before).count(); };
+
+	//longest glyph name at each position, via glyph_map:
+	std::vector< uint32_t > map_glyphs;
+	auto before = now();
+	for (uint32_t r = 0; r < repeats; ++r) {
+		map_glyphs.clear();
+		for (uint32_t start = 0; start < text.size(); /* later */) {
+			uint32_t glyph = -1U;
+			uint32_t length = 0;
+			for (uint32_t end = start + 1; end <= text.size(); ++end) {
+				auto f = font.glyph_map.find(text.substr(start, end - start));
+				if (f == font.glyph_map.end()) break;
+				glyph = f->second;
+				length = end - start;
+			}
+			map_glyphs.emplace_back(glyph);
+			start += (length ? length : 1);
+		}
+	}
+	double map_seconds = seconds(before, now());
+
+	//...and via the trie:
+	std::vector< uint32_t > trie_glyphs;
+	before = now();
+	for (uint32_t r = 0; r < repeats; ++r) {
+		trie_glyphs.clear();
+		char const *end = text.data() + text.size();
+		for (char const *at = text.data(); at < end; /* later */) {
+			uint32_t length = 0;
+			trie_glyphs.emplace_back(font.match(at, end, &length));
+			at += (length ? length : 1);
+		}
+	}
+	double trie_seconds = seconds(before, now());
+
+	double chars = double(repeats) * text.size();
+	std::cout << "\"" << text << "\" x " << repeats << ":\n";
+	std::cout << "  glyph_map + substr: " << (chars / map_seconds / 1.0e6) << "M chars/s\n";
+	std::cout << "  trie: " << (chars / trie_seconds / 1.0e6) << "M chars/s\n";
+	std::cout << "  glyphs " << (map_glyphs == trie_glyphs ? "match" : "DIFFER") << std::endl;
+
+	return (map_glyphs == trie_glyphs ? 0 : 1);
+}
@@ -0,0 +1,128 @@
+/*
+ * bench-light-grid times Scene::cull_lights, which sorts lights into screen tiles for draw() (see Scene::LightGrid):
+ *  - scatters point and spot lights (and one hemisphere light) around a camera and times filling a grid
+ *  - checks random points in view: every light that reaches a point must be listed in the point's tile
+ *  - fills grids for two scenes on two threads at once and checks they match grids filled one at a time
+ * cull_lights makes no OpenGL calls, so this runs without a GL context.
+ *
+ * Usage:
+ *   bench-light-grid [lights [repeats]]
+ */
+
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//scatter lights in front of a camera at the origin (looking down -z):
+static void add_lights(Scene *scene, uint32_t count, uint32_t seed) {
+	std::mt19937 mt(seed);
+	auto uniform = [&mt](float lo, float hi) { return std::uniform_real_distribution< float >(lo, hi)(mt); };
+
+	scene->transforms.emplace_back();
+	scene->cameras.emplace_back(&scene->transforms.back());
+
+	for (uint32_t i = 0; i < count; ++i) {
+		scene->transforms.emplace_back();
+		Scene::Transform &transform = scene->transforms.back();
+		transform.position = glm::vec3(uniform(-100.0f, 100.0f), uniform(-100.0f, 100.0f), uniform(-200.0f, 10.0f));
+		scene->lights.emplace_back(&transform);
+		Scene::Light &light = scene->lights.back();
+		light.type = (i == 0 ? Scene::Light::Hemisphere : (i % 4 == 0 ? Scene::Light::Spot : Scene::Light::Point));
+		light.energy = glm::vec3(uniform(0.0f, 1.0f), uniform(0.0f, 1.0f), uniform(0.0f, 1.0f));
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 500);
+	uint32_t repeats = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 1000);
+
+	Scene scene;
+	add_lights(&scene, count, 1);
+	Scene::Camera const &camera = scene.cameras.front();
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
+
+	Scene::LightGrid grid;
+	auto before = std::chrono::high_resolution_clock::now();
+	for (uint32_t r = 0; r < repeats; ++r) {
+		scene.cull_lights(world_to_clip, world_to_light, &grid);
+	}
+	double ms = std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - before).count() / repeats;
+
+	constexpr uint32_t TileCount = Scene::LightGrid::TilesX * Scene::LightGrid::TilesY;
+	uint32_t in_view = uint32_t(grid.lights.size() / 3);
+	double per_tile = double(grid.tiles.size() - (TileCount + 1)) / TileCount;
+
+	//check points in view (light space == world space here) against the lights that reach them:
+	std::mt19937 mt(2);
+	auto uniform = [&mt](float lo, float hi) { return std::uniform_real_distribution< float >(lo, hi)(mt); };
+	float tan_y = std::tan(0.5f * camera.fovy);
+	uint32_t points = 100000, missing = 0, reached = 0;
+	for (uint32_t p = 0; p < points; ++p) {
+		glm::vec2 ndc = glm::vec2(uniform(-0.999f, 0.999f), uniform(-0.999f, 0.999f));
+		float depth = uniform(1.0f, 120.0f);
+		glm::vec3 at = glm::vec3(ndc.x * depth * tan_y * camera.aspect, ndc.y * depth * tan_y, -depth);
+		glm::uvec2 tile = glm::uvec2(
+			uint32_t((ndc.x * 0.5f + 0.5f) * Scene::LightGrid::TilesX),
+			uint32_t((ndc.y * 0.5f + 0.5f) * Scene::LightGrid::TilesY)
+		);
+		uint32_t t = tile.y * Scene::LightGrid::TilesX + tile.x;
+		std::vector< uint32_t > listed(grid.tiles.begin() + grid.tiles[t], grid.tiles.begin() + grid.tiles[t+1]);
+		std::sort(listed.begin(), listed.end());
+
+		//lights in the grid (location.xyz, type) (direction.xyz, cos) (energy.rgb, range) that reach the point must be in its tile:
+		uint32_t grid_reaching = 0;
+		for (uint32_t l = 0; l < in_view; ++l) {
+			glm::vec4 location = grid.lights[3*l+0];
+			float range = grid.lights[3*l+2].w;
+			bool everywhere = (location.w == 1.0f || location.w == 3.0f);
+			if (!everywhere && glm::length(glm::vec3(location) - at) >= range) continue;
+			grid_reaching += 1;
+			if (!std::binary_search(listed.begin(), listed.end(), l)) missing += 1;
+		}
+
+		//...and lights culled from the grid entirely must not reach it:
+		uint32_t scene_reaching = 0;
+		for (auto const &light : scene.lights) {
+			if (light.type == Scene::Light::Point || light.type == Scene::Light::Spot) {
+				float energy = std::max(light.energy.x, std::max(light.energy.y, light.energy.z));
+				float range = std::sqrt(energy / Scene::LightCutoff);
+				if (glm::length(light.transform->position - at) >= range) continue;
+			}
+			scene_reaching += 1;
+		}
+		if (scene_reaching != grid_reaching) missing += 1;
+		reached += scene_reaching;
+	}
+
+	//fill grids for two scenes at once, and compare with grids filled one at a time:
+	Scene other;
+	add_lights(&other, count, 3);
+	Scene::LightGrid expected[2], threaded[2];
+	scene.cull_lights(world_to_clip, world_to_light, &expected[0]);
+	other.cull_lights(world_to_clip, world_to_light, &expected[1]);
+	std::thread thread([&]() {
+		for (uint32_t r = 0; r < repeats; ++r) other.cull_lights(world_to_clip, world_to_light, &threaded[1]);
+	});
+	for (uint32_t r = 0; r < repeats; ++r) scene.cull_lights(world_to_clip, world_to_light, &threaded[0]);
+	thread.join();
+	bool same = true;
+	for (uint32_t i = 0; i < 2; ++i) {
+		same = same && expected[i].lights == threaded[i].lights && expected[i].tiles == threaded[i].tiles;
+	}
+
+	std::cout << count << " lights (" << in_view << " in view), " << Scene::LightGrid::TilesX << "x" << Scene::LightGrid::TilesY << " tiles:\n";
+	std::cout << "  cull_lights: " << ms << " ms, " << per_tile << " lights per tile\n";
+	std::cout << "  " << points << " points in view, reached by " << (double(reached) / points) << " lights each on average: "
+		<< (missing == 0 ? "all lights listed" : std::to_string(missing) + " MISSING") << "\n";
+	std::cout << "  grids filled on two threads " << (same ? "match" : "DIFFER") << std::endl;
+
+	return (missing == 0 && same ? 0 : 1);
+}
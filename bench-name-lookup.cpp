@@ -0,0 +1,89 @@
+/*
+ * bench-name-lookup times Scene's transform name index (see Scene::find_transform and Scene::find_transforms):
+ *  builds a scene with many named transforms, then times
+ *   - looking up a sample of names by scanning the transform list
+ *   - building the index
+ *   - looking up every name through the index
+ *   - a prefix lookup
+ *  and checks that the index finds the same transforms as the scan (and notices a replaced transform).
+ *
+ * Usage:
+ *   bench-name-lookup [transforms [scanned]]
+ */
+
+#include "Scene.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 1000000);
+	uint32_t scanned = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 100);
+
+	Scene scene;
+	std::vector< std::string > names;
+	names.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		names.emplace_back((i % 3 == 0 ? "Tree." : "Cube.") + std::to_string(i));
+		scene.transforms.emplace_back();
+		scene.transforms.back().name = names.back();
+	}
+
+	auto now = []() { return std::chrono::high_resolution_clock::now(); };
+	auto ms = [](auto before, auto after) { return std::chrono::duration< double, std::milli >(after - before).count(); };
+
+	//the old way -- look at every transform:
+	auto scan = [&scene](std::string const &name) -> Scene::Transform * {
+		for (auto &t : scene.transforms) {
+			if (t.name == name) return &t;
+		}
+		return nullptr;
+	};
+
+	uint32_t mismatches = 0;
+	auto before = now();
+	std::vector< Scene::Transform * > scan_results;
+	for (uint32_t i = 0; i < scanned; ++i) {
+		scan_results.emplace_back(scan(names[(uint64_t(i) * 7919) % count]));
+	}
+	double scan_ms = ms(before, now());
+
+	before = now();
+	scene.index_names();
+	double index_ms = ms(before, now());
+
+	before = now();
+	uint32_t found = 0;
+	for (auto const &name : names) {
+		if (scene.find_transform(name)) found += 1;
+	}
+	double lookup_ms = ms(before, now());
+
+	for (uint32_t i = 0; i < scanned; ++i) {
+		if (scene.find_transform(names[(uint64_t(i) * 7919) % count]) != scan_results[i]) mismatches += 1;
+	}
+	if (scene.find_transform("Nope") != nullptr) mismatches += 1;
+
+	before = now();
+	Scene::TransformSpan trees = scene.find_transforms("Tree.");
+	double prefix_ms = ms(before, now());
+	if (trees.size() != (count + 2) / 3) mismatches += 1;
+
+	//replacing a transform (so the count stays the same) must not leave the index pointing at the old one:
+	scene.transforms.pop_front();
+	scene.transforms.emplace_back();
+	scene.transforms.back().name = "Replacement";
+	if (scene.find_transform(names[0]) != nullptr) mismatches += 1;
+	if (scene.find_transform("Replacement") != &scene.transforms.back()) mismatches += 1;
+
+	std::cout << count << " transforms:\n";
+	std::cout << "  scanning: " << (scan_ms / scanned) << " ms per lookup\n";
+	std::cout << "  building index: " << index_ms << " ms\n";
+	std::cout << "  indexed: " << (lookup_ms * 1.0e6 / count) << " ns per lookup (" << found << " found)\n";
+	std::cout << "  prefix lookup: " << (prefix_ms * 1.0e3) << " us (" << trees.size() << " transforms)\n";
+	std::cout << "  mismatches: " << mismatches << std::endl;
+
+	return (mismatches == 0 && found == count ? 0 : 1);
+}
@@ -0,0 +1,80 @@
+/*
+ * bench-sound-commands stress-tests the game thread -> mixer command queue (see Sound.cpp):
+ *  it keeps a few hundred 3D voices playing on the audio device and, every frame,
+ *  sends thousands of position updates (plus some plays and stops) without ever taking the audio lock.
+ *
+ * Usage:
+ *   bench-sound-commands [frames [updates-per-frame [voices]]]
+ *
+ * Prints the time spent sending commands per frame, along with Sound::mix_overruns
+ *  (mixer blocks that took longer than the audio they produced) and Sound::dropped_commands.
+ */
+
+#include "Sound.hpp"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t frames = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 600);
+	uint32_t updates = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 10000);
+	uint32_t voice_count = (argc > 3 ? uint32_t(std::stoul(argv[3])) : 300);
+
+	Sound::init();
+
+	//a two-second tone to play:
+	std::vector< float > data(48000 * 2);
+	for (size_t i = 0; i < data.size(); ++i) {
+		data[i] = 0.1f * std::sin(float(i) * 0.05f);
+	}
+	Sound::Sample sample(data);
+
+	std::vector< std::shared_ptr< Sound::PlayingSample > > voices;
+	double send_seconds = 0.0;
+	double max_send_seconds = 0.0;
+	for (uint32_t frame = 0; frame < frames; ++frame) {
+		auto before = std::chrono::high_resolution_clock::now();
+
+		//keep voices coming and going:
+		while (voices.size() < voice_count) {
+			voices.emplace_back(Sound::loop_3D(sample, 1.0f, glm::vec3(float(voices.size()), 0.0f, 0.0f), 10.0f));
+		}
+		if (frame % 7 == 0) {
+			voices.front()->stop();
+			voices.erase(voices.begin());
+		}
+
+		//lots of parameter changes:
+		for (uint32_t u = 0; u < updates; ++u) {
+			float t = float(frame) + float(u) / float(updates);
+			voices[u % voices.size()]->set_position(glm::vec3(10.0f * std::cos(t), 10.0f * std::sin(t), 0.0f));
+		}
+		Sound::listener.set_position_right(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+
+		double elapsed = std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+		send_seconds += elapsed;
+		max_send_seconds = std::max(max_send_seconds, elapsed);
+
+		//wait out the rest of a 60Hz frame:
+		std::this_thread::sleep_for(std::chrono::duration< double >(std::max(0.0, 1.0 / 60.0 - elapsed)));
+	}
+
+	Sound::stop_all_samples();
+	voices.clear();
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	Sound::shutdown();
+
+	std::cout << frames << " frames of " << updates << " updates to " << voice_count << " voices:\n";
+	std::cout << "  sending commands: " << (send_seconds / frames * 1000.0) << " ms/frame average, " << (max_send_seconds * 1000.0) << " ms worst\n";
+	std::cout << "  mix overruns: " << Sound::mix_overruns.load() << "\n";
+	std::cout << "  dropped commands: " << Sound::dropped_commands.load() << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * bench-sound-mix measures how fast mix_audio mixes voices (see mix_run in Sound.cpp),
+ *  by rendering a mix of looping 2D and 3D voices offline (no audio device needed).
+ *
+ * Usage:
+ *   bench-sound-mix [voices [seconds]]
+ *
+ * Prints the time taken, mixed voice-samples per second, how many times faster than
+ *  real time the mix ran, and a checksum of the output (to compare builds with and without SSE/AVX).
+ */
+
+#include "Sound.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t voice_count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 64);
+	float seconds = (argc > 2 ? std::stof(argv[2]) : 10.0f);
+
+	Sound::init_offline();
+
+	//samples of different (odd) lengths, so loop points land all over the mix blocks:
+	std::vector< std::unique_ptr< Sound::Sample > > samples;
+	for (uint32_t s = 0; s < 4; ++s) {
+		std::vector< float > data(4801 + 1777 * s);
+		for (size_t i = 0; i < data.size(); ++i) {
+			data[i] = 0.05f * std::sin(float(i) * (0.01f + 0.005f * s));
+		}
+		samples.emplace_back(std::make_unique< Sound::Sample >(data));
+	}
+
+	std::vector< std::shared_ptr< Sound::PlayingSample > > voices;
+	for (uint32_t v = 0; v < voice_count; ++v) {
+		Sound::Sample const &sample = *samples[v % samples.size()];
+		if (v % 2 == 0) {
+			voices.emplace_back(Sound::loop(sample, 1.0f, std::sin(float(v))));
+		} else {
+			voices.emplace_back(Sound::loop_3D(sample, 1.0f, glm::vec3(std::cos(float(v)), std::sin(float(v)), 0.0f) * float(v), 5.0f));
+		}
+	}
+
+	uint32_t frames = uint32_t(seconds * 48000.0f);
+	std::vector< float > out(2 * size_t(frames));
+
+	auto before = std::chrono::high_resolution_clock::now();
+	Sound::render_offline(frames, out.data());
+	double elapsed = std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+
+	double checksum = 0.0;
+	for (size_t i = 0; i < out.size(); ++i) {
+		checksum += double(out[i]) * double(i % 7 + 1);
+	}
+
+	std::cout << voice_count << " voices for " << seconds << "s mixed in " << (elapsed * 1000.0) << " ms:\n";
+	std::cout << "  " << (double(voice_count) * frames / elapsed / 1.0e6) << "M voice-samples/s\n";
+	std::cout << "  " << (seconds / elapsed) << "x real time\n";
+	std::cout << "  checksum " << checksum << std::endl;
+
+	return 0;
+}
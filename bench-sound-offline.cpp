@@ -0,0 +1,73 @@
+/*
+ * bench-sound-offline checks and times Sound::render_offline:
+ *  - renders the same voices once in a single call and once in odd-sized pieces,
+ *    and checks that the two renders are identical
+ *  - times a long render of two voices
+ *  - (optionally) renders the same two voices to a .wav file
+ *
+ * Usage:
+ *   bench-sound-offline [seconds [out.wav]]
+ */
+
+#include "Sound.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	float seconds = (argc > 1 ? std::stof(argv[1]) : 60.0f);
+	std::string wav = (argc > 2 ? argv[2] : "");
+	constexpr uint32_t BlockFrames = 1024; //(one mix block)
+
+	Sound::init_offline();
+
+	std::vector< float > data(3001);
+	for (size_t i = 0; i < data.size(); ++i) {
+		data[i] = std::sin(float(i) * 0.05f);
+	}
+	Sound::Sample sample(data);
+
+	//render two voices for 'frames' frames, in pieces of the given sizes (repeated as needed):
+	auto render = [&](uint32_t frames, std::vector< uint32_t > const &pieces) {
+		auto a = Sound::loop(sample, 0.7f, -0.3f);
+		auto b = Sound::loop_3D(sample, 1.0f, glm::vec3(3.0f, 1.0f, 0.0f), 2.0f);
+		std::vector< float > out(2 * size_t(frames));
+		for (uint32_t at = 0, p = 0; at < frames; ++p) {
+			uint32_t count = std::min(frames - at, pieces[p % pieces.size()]);
+			Sound::render_offline(count, out.data() + 2 * size_t(at));
+			at += count;
+		}
+		//stop the voices and render until they are gone, ending on a block boundary so the next render starts fresh:
+		a->stop(0.0f);
+		b->stop(0.0f);
+		std::vector< float > tail(2 * BlockFrames);
+		Sound::render_offline(BlockFrames - frames % BlockFrames, tail.data());
+		Sound::render_offline(BlockFrames, tail.data());
+		return out;
+	};
+
+	uint32_t check_frames = 10000;
+	std::vector< float > whole = render(check_frames, { check_frames });
+	std::vector< float > pieces = render(check_frames, { 1, 7, 1500, 1024, 3000, 4468 });
+	bool same = (whole == pieces);
+	std::cout << "whole vs. piecewise render of " << check_frames << " frames: " << (same ? "identical" : "DIFFERENT") << "\n";
+
+	uint32_t frames = uint32_t(seconds * 48000.0f);
+	auto before = std::chrono::high_resolution_clock::now();
+	std::vector< float > out = render(frames, { frames });
+	double elapsed = std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+	std::cout << "two voices for " << seconds << "s rendered in " << (elapsed * 1000.0) << " ms" << std::endl;
+
+	if (wav != "") {
+		auto a = Sound::loop(sample, 0.7f, -0.3f);
+		auto b = Sound::loop_3D(sample, 1.0f, glm::vec3(3.0f, 1.0f, 0.0f), 2.0f);
+		Sound::render_offline(frames, wav);
+		std::cout << "wrote " << wav << std::endl;
+	}
+
+	return (same ? 0 : 1);
+}
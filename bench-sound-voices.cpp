@@ -0,0 +1,110 @@
+/*
+ * bench-sound-voices checks that the mixer's voice pool (see Sound.cpp) never allocates:
+ *  it starts many voices, renders mix blocks offline while counting heap allocations,
+ *  stops everything part-way through, and then checks that every handle reports stopped().
+ *
+ * Usage:
+ *   bench-sound-voices [voices [blocks]]
+ *
+ * Prints the number of allocations made while mixing (should be zero) and the time per mix block.
+ *
+ * Only offline mixing is measured: render_offline() runs the same mix_audio() as the device
+ *  callback, but on this thread, with the commands already queued -- there is no audio device here.
+ */
+
+#include "Sound.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+//Replacement global allocation functions that count allocations while 'counting' is set:
+// (the benchmark only ever mixes on the main thread, so plain globals are enough)
+// (optimizing gcc inlines these into library code and then mistakes free() for a mismatched deallocation)
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static bool counting = false;
+static uint64_t allocations = 0;
+
+void *operator new(std::size_t size) {
+	if (counting) allocations += 1;
+	if (size == 0) size = 1;
+	while (true) {
+		if (void *ptr = std::malloc(size)) return ptr;
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+}
+
+void *operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+int main(int argc, char **argv) {
+	uint32_t voice_count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 1000);
+	uint32_t blocks = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 50);
+	constexpr uint32_t BlockFrames = 1024; //(one mix block)
+
+	Sound::init_offline();
+
+	std::vector< float > data(48000);
+	for (size_t i = 0; i < data.size(); ++i) {
+		data[i] = 0.01f * std::sin(float(i) * 0.02f);
+	}
+	Sound::Sample sample(data);
+
+	std::vector< std::shared_ptr< Sound::PlayingSample > > voices;
+	for (uint32_t v = 0; v < voice_count; ++v) {
+		if (v % 2 == 0) {
+			voices.emplace_back(Sound::loop(sample, 1.0f, 0.0f));
+		} else {
+			voices.emplace_back(Sound::play_3D(sample, 1.0f, glm::vec3(float(v), 0.0f, 0.0f), 10.0f));
+		}
+	}
+
+	std::vector< float > out(2 * BlockFrames);
+	double elapsed = 0.0;
+	for (uint32_t b = 0; b < blocks; ++b) {
+		if (b == blocks / 2) Sound::stop_all_samples();
+
+		auto before = std::chrono::high_resolution_clock::now();
+		counting = true;
+		Sound::render_offline(BlockFrames, out.data());
+		counting = false;
+		elapsed += std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+	}
+
+	uint32_t playing = 0;
+	for (auto const &voice : voices) {
+		if (!voice->stopped()) playing += 1;
+	}
+
+	std::cout << voice_count << " voices, " << blocks << " mix blocks (stop_all_samples() after " << (blocks / 2) << "):\n";
+	std::cout << "  allocations while mixing (offline): " << allocations << "\n";
+	std::cout << "  " << (elapsed / blocks * 1000.0) << " ms per block\n";
+	std::cout << "  voices still playing at the end: " << playing << std::endl;
+
+	return (allocations == 0 && playing == 0 ? 0 : 1);
+}
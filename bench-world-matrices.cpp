@@ -0,0 +1,111 @@
+/*
+ * bench-world-matrices times Scene's world matrix cache (see Scene::update_world_matrices):
+ *  builds a scene of transforms in chains of depth 1-16 and times
+ *   - computing every world matrix by walking up the hierarchy (no cache)
+ *   - the first update_world_matrices() (which also sorts the hierarchy) and an update with nothing changed
+ *   - looking up every world matrix (and its inverse) through the cache
+ *   - an update after moving some transforms
+ *  then checks the cached matrices (and inverses) against ones computed without the cache.
+ *
+ * Usage:
+ *   bench-world-matrices [transforms [moved]]
+ */
+
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//world matrix computed without the cache:
+static glm::mat4x3 uncached_local_to_world(Scene::Transform const *t) {
+	glm::mat4x3 local_to_parent = t->make_local_to_parent();
+	if (!t->parent) return local_to_parent;
+	return uncached_local_to_world(t->parent) * glm::mat4(local_to_parent); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+}
+static glm::mat4x3 uncached_world_to_local(Scene::Transform const *t) {
+	glm::mat4x3 parent_to_local = t->make_parent_to_local();
+	if (!t->parent) return parent_to_local;
+	return parent_to_local * glm::mat4(uncached_world_to_local(t->parent));
+}
+
+int main(int argc, char **argv) {
+	uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 100000);
+	uint32_t moved = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 1000);
+
+	Scene scene;
+	std::mt19937 mt(0x15466);
+	std::vector< Scene::Transform * > transforms;
+	transforms.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		scene.transforms.emplace_back();
+		Scene::Transform *t = &scene.transforms.back();
+		t->position = glm::vec3((mt() % 100) * 0.01f, 0.1f, 0.2f);
+		t->rotation = glm::normalize(glm::quat(1.0f, 0.1f * (mt() % 3), 0.0f, 0.1f));
+		if (i % 16 != 0) t->parent = transforms.back();
+		transforms.emplace_back(t);
+	}
+
+	auto now = []() { return std::chrono::high_resolution_clock::now(); };
+	auto ms = [](auto before, auto after) { return std::chrono::duration< double, std::milli >(after - before).count(); };
+
+	float sum = 0.0f; //(keeps lookups from being optimized away)
+
+	auto before = now();
+	for (auto *t : transforms) sum += uncached_local_to_world(t)[3][0];
+	double uncached = ms(before, now());
+
+	before = now();
+	scene.update_world_matrices();
+	double first_update = ms(before, now());
+
+	before = now();
+	scene.update_world_matrices();
+	double clean_update = ms(before, now());
+
+	before = now();
+	for (auto *t : transforms) sum += t->make_local_to_world()[3][0];
+	double cached = ms(before, now());
+
+	before = now();
+	for (auto *t : transforms) sum += t->make_world_to_local()[3][0];
+	double cached_inverse = ms(before, now());
+
+	for (uint32_t i = 0; i < moved; ++i) {
+		Scene::Transform *t = transforms[mt() % transforms.size()];
+		t->position.x += 1.0f;
+		t->mark_dirty();
+	}
+	before = now();
+	scene.update_world_matrices();
+	double moved_update = ms(before, now());
+
+	float max_error = 0.0f;
+	for (auto *t : transforms) {
+		glm::mat4x3 a = t->make_local_to_world();
+		glm::mat4x3 b = uncached_local_to_world(t);
+		glm::mat4x3 a_inv = t->make_world_to_local();
+		glm::mat4x3 b_inv = uncached_world_to_local(t);
+		for (uint32_t c = 0; c < 4; ++c) {
+			for (uint32_t r = 0; r < 3; ++r) {
+				max_error = std::max(max_error, std::abs(a[c][r] - b[c][r]));
+				max_error = std::max(max_error, std::abs(a_inv[c][r] - b_inv[c][r]));
+			}
+		}
+	}
+
+	std::cout << count << " transforms in chains of depth 1-16:\n";
+	std::cout << "  uncached lookups: " << uncached << " ms\n";
+	std::cout << "  first update: " << first_update << " ms\n";
+	std::cout << "  unchanged update: " << clean_update << " ms\n";
+	std::cout << "  cached lookups: " << cached << " ms\n";
+	std::cout << "  cached inverse lookups: " << cached_inverse << " ms\n";
+	std::cout << "  update after moving " << moved << ": " << moved_update << " ms\n";
+	std::cout << "  largest difference from uncached matrices: " << max_error << " (checksum " << sum << ")" << std::endl;
+
+	return (max_error == 0.0f ? 0 : 1);
+}
@@ -1,9 +1,10 @@
 #include "load_opus.hpp"
+#include "Load.hpp"
 
 #include <opusfile.h>
 
 #include <cassert>
-#include <memory>
+#include <algorithm>
 #include <cmath>
 #include <stdexcept>
 #include <iostream>
@@ -15,40 +16,62 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 
 	std::cout << "loading '" << filename << "'..."; std::cout.flush();
 
-	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
-	int err = 0;
-	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
-		op_open_file(filename.c_str(), &err), //pointer to hold
-		op_free //deletion function
-	);
-	if (err != 0) {
-		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
-	}
+	OpusReader reader(filename);
 
 	//get length in samples:
-	ogg_int64_t length = op_pcm_total(op.get(), -1);
-	if (length >= 0) {
-		data.reserve(length);
+	if (reader.length >= 0) {
+		data.reserve(reader.length);
 	} else {
 		std::cerr << "WARNING: cannot estimate length of '" << filename << "', loading may be slow." << std::endl;
-		length = 0;
 		data.reserve(2*48000);
 	}
 
-	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
+	std::vector< float > mono(2*48000, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
 	for (;;) {
-		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
-		if (ret >= 0) {
-			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
-			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
-				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
-			}
-			if (ret == 0) break;
-		} else {
-			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
-		}
+		uint32_t count = reader.read(mono.data(), uint32_t(mono.size()));
+		if (count == 0) break;
+		data.insert(data.end(), mono.begin(), mono.begin() + count);
 	}
 
+	opus_int64 bytes = op_raw_total(reader.op, -1);
+	if (bytes > 0) load_stats_read(size_t(bytes));
+
 	std::cout << " done." << std::endl;
 }
+
+OpusReader::OpusReader(std::string const &filename_) : filename(filename_) {
+	int err = 0;
+	op = op_open_file(filename.c_str(), &err);
+	if (err != 0) {
+		if (op) op_free(op);
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+	length = op_pcm_total(op, -1);
+	if (length < 0) length = -1;
+}
+
+OpusReader::~OpusReader() {
+	op_free(op);
+}
+
+uint32_t OpusReader::read(float *data, uint32_t count) {
+	if (pcm.size() < 2 * size_t(count)) pcm.resize(2 * size_t(count));
+	int ret = op_read_float_stereo(op, pcm.data(), int(2 * count));
+	if (ret < 0) {
+		throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+	}
+	//positive return values are the number of samples read per channel:
+	for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+		data[i] = (pcm[2*i] + pcm[2*i+1]) * 0.5f; //downmix to mono by averaging
+	}
+	return uint32_t(ret);
+}
+
+void OpusReader::seek(int64_t sample) {
+	if (length >= 0) sample = std::min(sample, length);
+	sample = std::max< int64_t >(sample, 0);
+	int ret = op_pcm_seek(op, sample);
+	if (ret != 0) {
+		throw std::runtime_error("opusfile error " + std::to_string(ret) + " seeking in \"" + filename + "\".");
+	}
+}
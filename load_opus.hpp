@@ -2,6 +2,30 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 //Load an opus file as 48kHz floating-point mono; throws on error:
 void load_opus(std::string const &filename, std::vector< float > *data);
+
+//Decode an opus file a piece at a time (as 48kHz floating-point mono); throws on error:
+// (used for streaming playback of files too long to keep decoded in memory)
+struct OggOpusFile;
+struct OpusReader {
+	OpusReader(std::string const &filename);
+	~OpusReader();
+	OpusReader(OpusReader const &) = delete;
+	OpusReader &operator=(OpusReader const &) = delete;
+
+	//decode up to 'count' samples into 'data'; returns number of samples decoded (0 at end of file):
+	uint32_t read(float *data, uint32_t count);
+
+	//move to a given sample (clamped to the length of the file):
+	void seek(int64_t sample);
+
+	//total length in samples (or -1 if it can't be determined):
+	int64_t length = -1;
+
+	std::string filename; //(used in error messages)
+	OggOpusFile *op = nullptr;
+	std::vector< float > pcm; //stereo data from the decoder
+};
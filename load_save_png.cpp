@@ -1,4 +1,5 @@
 #include "load_save_png.hpp"
+#include "Load.hpp"
 
 #include <png.h>
 
@@ -24,6 +25,8 @@ void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 >
 	if (!load_png(file, &size->x, &size->y, data, origin)) {
 		throw std::runtime_error("Failed to read PNG image from '" + filename + "'.");
 	}
+	std::streamoff bytes = file.tellg();
+	if (bytes > 0) load_stats_read(size_t(bytes));
 }
 
 void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin) {
@@ -1,4 +1,5 @@
 #include "load_wav.hpp"
+#include "Load.hpp"
 
 #include <SDL.h>
 
@@ -20,6 +21,7 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	if (!have) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
+	load_stats_read(audio_len);
 
 	//based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT
 	SDL_AudioCVT cvt;
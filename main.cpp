@@ -16,6 +16,9 @@
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
+//for resetting per-frame line streaming counters:
+#include "DrawLines.hpp"
+
 //for screenshots:
 #include "load_save_png.hpp"
 
@@ -174,7 +177,7 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			DrawLines::begin_frame();
 			Mode::current->draw(drawable_size);
 		}
 
@@ -514,6 +514,32 @@ for m in range(0x20, 0x7f):
 		missing.append(c)
 print("Font misses: " + ", ".join(map(lambda x: "'" + x + "'", missing)))
 
+#build a lookup trie over the bytes of glyph names (so names can be multi-byte, e.g., UTF-8):
+# node 0 is the root; each node has 256 entries (one per next byte) giving
+# the glyph whose name ends with that byte (or NoGlyph) and the node that continues longer names (or 0 if none)
+NoGlyph = 0xffffffff
+out_trie_glyphs = [NoGlyph] * 256
+out_trie_next = [0] * 256
+for g in range(0, out_glyphs):
+	name = out_chars[out_glyph_char_starts[g]:(out_glyph_char_starts[g+1] if g + 1 < out_glyphs else len(out_chars))]
+	if len(name) == 0:
+		print("WARNING: ignoring glyph with empty name.")
+		continue
+	node = 0
+	for b in name[0:-1]:
+		e = node * 256 + b
+		if out_trie_next[e] == 0:
+			out_trie_next[e] = len(out_trie_next) // 256
+			out_trie_glyphs += [NoGlyph] * 256
+			out_trie_next += [0] * 256
+		node = out_trie_next[e]
+	e = node * 256 + name[-1]
+	if out_trie_glyphs[e] != NoGlyph:
+		print("WARNING: ignoring duplicate glyph for '" + bytes(name).decode('utf8') + "'.")
+	else:
+		out_trie_glyphs[e] = g
+print("Trie has " + str(len(out_trie_next) // 256) + " nodes.")
+
 print("Writing PathFont '" + fontname + "' to '" + cppname + "'")
 
 cppfile = open(cppname, 'wb')
@@ -553,8 +579,17 @@ w('\tconstexpr const float font_coords[' + str(len(out_coords)) + '] = {\n')
 wd(out_coords, "{:.6f}f", 6)
 w('\t};\n')
 
+w('\tconstexpr const uint32_t font_trie_nodes = ' + str(len(out_trie_next) // 256) + ';\n')
+w('\tconstexpr const uint32_t font_trie_glyphs[font_trie_nodes*256] = {\n')
+wd(list(map(lambda g: "-1U" if g == NoGlyph else str(g), out_trie_glyphs)), "{}", 16)
+w('\t};\n')
+
+w('\tconstexpr const uint32_t font_trie_next[font_trie_nodes*256] = {\n')
+wd(out_trie_next, "{}", 16)
+w('\t};\n')
+
 
 w('}\n')
-w('PathFont PathFont::font(font_glyphs, font_glyph_widths, font_glyph_char_starts, font_chars, font_glyph_coord_starts, font_coords);\n')
+w('PathFont PathFont::font(font_glyphs, font_glyph_widths, font_glyph_char_starts, font_chars, font_glyph_coord_starts, font_coords, font_trie_glyphs, font_trie_next);\n')
 
 cppfile.close()
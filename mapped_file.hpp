@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * MappedFile maps a whole file read-only into memory.
+ * Loaders can then look at file contents in place (see read_chunk(ChunkCursor *, ...))
+ * without first copying them into freshly allocated buffers.
+ *
+ */
+
+#include <string>
+#include <cstddef>
+
+struct MappedFile {
+	//map file; throws on failure:
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	std::string filename;
+	char const *data = nullptr; //first byte of file (page-aligned)
+	size_t size = 0; //size of file in bytes
+
+	char const *begin() const { return data; }
+	char const *end() const { return data + size; }
+
+	//-- internals --
+	#ifdef _WIN32
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+};
@@ -0,0 +1,420 @@
+/*
+ * optimize-meshes converts a .pnct file (e.g., the triangle soup written by export-meshes.py)
+ *  into an indexed .pnct file that MeshBuffer draws with glDrawElements:
+ *   - identical vertices within each mesh are merged
+ *   - triangles are reordered for the post-transform vertex cache (Forsyth's algorithm)
+ *   - vertices are reordered into the order triangles first use them (for fetch locality)
+ * With --quantize, vertices are also packed from 36 to 20 bytes (see PackedVertex in Mesh.cpp):
+ *   - positions as 16-bit fractions of each mesh's bounding box
+ *   - normals as 10:10:10 signed normalized values
+ *   - texture coordinates as half floats
+ *
+ * Usage:
+ *   optimize-meshes [--quantize] <in.pnct> <out.pnct>
+ *
+ * Prints vertex counts and average cache miss ratios (ACMR) before and after,
+ *  and (with --quantize) the largest quantization errors in each mesh.
+ */
+
+#include "read_write_chunk.hpp"
+#include "mapped_file.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+struct PackedVertex {
+	glm::u16vec4 Position;
+	uint32_t Normal;
+	glm::u8vec4 Color;
+	glm::u16vec2 TexCoord;
+};
+static_assert(sizeof(PackedVertex) == 4*2+4+4*1+2*2, "PackedVertex is packed.");
+
+struct Bounds {
+	glm::vec3 min, max;
+};
+static_assert(sizeof(Bounds) == 6*4, "Bounds is packed.");
+
+//mesh file index entries (see MeshBuffer::MeshBuffer):
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+struct IndexedEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+	uint32_t element_begin, element_end;
+};
+static_assert(sizeof(IndexedEntry) == 24, "Indexed entry should be packed");
+
+//average cache miss ratio (vertices transformed per triangle) for a FIFO post-transform cache:
+static constexpr uint32_t ACMRCacheSize = 32;
+static float acmr(std::vector< uint32_t > const &indices) {
+	if (indices.empty()) return 0.0f;
+	uint32_t vertex_count = *std::max_element(indices.begin(), indices.end()) + 1;
+	//vertex is in the cache if it was added during the last ACMRCacheSize misses:
+	std::vector< uint32_t > added(vertex_count, -1U);
+	uint32_t misses = 0;
+	for (uint32_t i : indices) {
+		if (added[i] == -1U || added[i] + ACMRCacheSize <= misses) {
+			added[i] = misses;
+			misses += 1;
+		}
+	}
+	return float(misses) / float(indices.size() / 3);
+}
+
+//Tom Forsyth's "Linear-Speed Vertex Cache Optimisation":
+// greedily emits the triangle with the highest score, where vertices score higher
+// when they are recently used (in a simulated LRU cache) or have few triangles left.
+static constexpr uint32_t ForsythCacheSize = 32;
+static float forsyth_vertex_score(int32_t cache_position, uint32_t remaining) {
+	if (remaining == 0) return -1.0f; //(vertex isn't used by any more triangles)
+	float score = 0.0f;
+	if (cache_position >= 0) {
+		if (cache_position < 3) {
+			score = 0.75f; //(used by the last triangle; fixed score so that strips aren't favored)
+		} else {
+			score = std::pow(1.0f - float(cache_position - 3) / float(ForsythCacheSize - 3), 1.5f);
+		}
+	}
+	//boost vertices with few triangles left, so they get finished off:
+	score += 2.0f * std::pow(float(remaining), -0.5f);
+	return score;
+}
+
+static std::vector< uint32_t > reorder_triangles(std::vector< uint32_t > const &indices, uint32_t vertex_count) {
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	//triangles using each vertex are stored in adjacency[offsets[v], offsets[v] + remaining[v]):
+	std::vector< uint32_t > offsets(vertex_count + 1, 0);
+	for (uint32_t i : indices) offsets[i + 1] += 1;
+	for (uint32_t v = 0; v < vertex_count; ++v) offsets[v + 1] += offsets[v];
+	std::vector< uint32_t > remaining(vertex_count, 0);
+	std::vector< uint32_t > adjacency(indices.size());
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		for (uint32_t c = 0; c < 3; ++c) {
+			uint32_t v = indices[3*t+c];
+			adjacency[offsets[v] + remaining[v]] = t;
+			remaining[v] += 1;
+		}
+	}
+
+	std::vector< int32_t > cache_position(vertex_count, -1);
+	std::vector< float > vertex_score(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		vertex_score[v] = forsyth_vertex_score(-1, remaining[v]);
+	}
+	std::vector< float > triangle_score(triangle_count);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		triangle_score[t] = vertex_score[indices[3*t+0]] + vertex_score[indices[3*t+1]] + vertex_score[indices[3*t+2]];
+	}
+	std::vector< bool > emitted(triangle_count, false);
+
+	std::vector< uint32_t > out;
+	out.reserve(indices.size());
+	std::vector< uint32_t > cache, next_cache;
+	uint32_t best = uint32_t(std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin());
+	uint32_t scan = 0; //(for finding an un-emitted triangle when nothing in the cache is useful)
+
+	for (uint32_t n = 0; n < triangle_count; ++n) {
+		if (best == -1U) {
+			while (emitted[scan]) ++scan;
+			best = scan;
+		}
+
+		//emit triangle and remove it from its vertices' adjacency lists:
+		emitted[best] = true;
+		uint32_t const *tri = &indices[3*best];
+		for (uint32_t c = 0; c < 3; ++c) {
+			uint32_t v = tri[c];
+			out.emplace_back(v);
+			uint32_t *list = &adjacency[offsets[v]];
+			uint32_t *found = std::find(list, list + remaining[v], best);
+			std::swap(*found, list[remaining[v] - 1]);
+			remaining[v] -= 1;
+		}
+
+		//move triangle's vertices to the front of the cache:
+		next_cache.assign(tri, tri + 3);
+		for (uint32_t v : cache) {
+			if (v != tri[0] && v != tri[1] && v != tri[2]) next_cache.emplace_back(v);
+		}
+
+		//update scores of vertices that moved in the cache (including any that fell out):
+		for (uint32_t i = 0; i < next_cache.size(); ++i) {
+			uint32_t v = next_cache[i];
+			cache_position[v] = (i < ForsythCacheSize ? int32_t(i) : -1);
+			vertex_score[v] = forsyth_vertex_score(cache_position[v], remaining[v]);
+		}
+		if (next_cache.size() > ForsythCacheSize) next_cache.resize(ForsythCacheSize);
+		std::swap(cache, next_cache);
+
+		//update scores of triangles using cached vertices; pick the best one next:
+		best = -1U;
+		float best_score = -1.0f;
+		for (uint32_t v : cache) {
+			for (uint32_t a = offsets[v]; a < offsets[v] + remaining[v]; ++a) {
+				uint32_t t = adjacency[a];
+				triangle_score[t] = vertex_score[indices[3*t+0]] + vertex_score[indices[3*t+1]] + vertex_score[indices[3*t+2]];
+				if (triangle_score[t] > best_score) {
+					best_score = triangle_score[t];
+					best = t;
+				}
+			}
+		}
+	}
+
+	return out;
+}
+
+int main(int argc, char **argv) {
+	bool quantize = (argc == 4 && std::string(argv[1]) == "--quantize");
+	if (argc != 3 && !quantize) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--quantize] <in.pnct> <out.pnct>" << std::endl;
+		return 1;
+	}
+	std::string in_filename = argv[argc-2];
+	std::string out_filename = argv[argc-1];
+
+	try {
+		MappedFile mapped(in_filename);
+		ChunkTable chunks(mapped.begin(), mapped.end());
+
+		ChunkSpan< Vertex > vertices;
+		chunks.read("pnct", &vertices);
+		ChunkSpan< char > strings;
+		chunks.read("str0", &strings);
+
+		//each mesh as a name and a list of triangle corners (indices into 'vertices'):
+		struct InMesh {
+			std::string name;
+			std::vector< uint32_t > corners;
+		};
+		std::vector< InMesh > in_meshes;
+		auto get_name = [&](uint32_t begin, uint32_t end) {
+			if (!(begin <= end && end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			return std::string(strings.data() + begin, strings.data() + end);
+		};
+		if (chunks.find("idx1")) { //already indexed (so re-optimize):
+			ChunkSpan< uint32_t > elements;
+			chunks.read("elm0", &elements);
+			ChunkSpan< IndexedEntry > index;
+			chunks.read("idx1", &index);
+			for (auto const &entry : index) {
+				if (!(entry.element_begin <= entry.element_end && entry.element_end <= elements.size())) {
+					throw std::runtime_error("index entry has out-of-range element start/count");
+				}
+				in_meshes.emplace_back();
+				in_meshes.back().name = get_name(entry.name_begin, entry.name_end);
+				for (uint32_t e = entry.element_begin; e < entry.element_end; ++e) {
+					if (elements[e] >= vertices.size()) throw std::runtime_error("element out of range");
+					in_meshes.back().corners.emplace_back(elements[e]);
+				}
+			}
+		} else {
+			ChunkSpan< IndexEntry > index;
+			chunks.read("idx0", &index);
+			for (auto const &entry : index) {
+				if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= vertices.size())) {
+					throw std::runtime_error("index entry has out-of-range vertex start/count");
+				}
+				in_meshes.emplace_back();
+				in_meshes.back().name = get_name(entry.name_begin, entry.name_end);
+				for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+					in_meshes.back().corners.emplace_back(v);
+				}
+			}
+		}
+
+		std::vector< Vertex > out_vertices;
+		std::vector< uint32_t > out_elements;
+		std::vector< char > out_strings;
+		std::vector< IndexedEntry > out_index;
+
+		uint64_t total_before = 0, total_after = 0;
+		double total_misses_before = 0.0, total_misses_after = 0.0;
+		uint64_t total_triangles = 0;
+
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "mesh: vertices before -> after, ACMR (FIFO " << ACMRCacheSize << ") before -> indexed -> optimized\n";
+		for (auto const &mesh : in_meshes) {
+			if (mesh.corners.size() % 3 != 0) {
+				throw std::runtime_error("mesh '" + mesh.name + "' isn't made of triangles");
+			}
+
+			//merge identical vertices (exact bitwise match):
+			std::unordered_map< std::string, uint32_t > unique;
+			std::vector< Vertex > local_vertices;
+			std::vector< uint32_t > local;
+			local.reserve(mesh.corners.size());
+			for (uint32_t c : mesh.corners) {
+				std::string key(reinterpret_cast< char const * >(&vertices[c]), sizeof(Vertex));
+				auto ret = unique.emplace(key, uint32_t(local_vertices.size()));
+				if (ret.second) local_vertices.emplace_back(vertices[c]);
+				local.emplace_back(ret.first->second);
+			}
+
+			//drop triangles that merging made degenerate:
+			uint32_t degenerate = 0;
+			{
+				std::vector< uint32_t > kept;
+				kept.reserve(local.size());
+				for (uint32_t t = 0; t + 2 < local.size(); t += 3) {
+					if (local[t] == local[t+1] || local[t+1] == local[t+2] || local[t] == local[t+2]) {
+						++degenerate;
+						continue;
+					}
+					kept.insert(kept.end(), &local[t], &local[t] + 3);
+				}
+				local = std::move(kept);
+			}
+
+			//for comparison, misses with the original vertex order:
+			std::vector< uint32_t > soup(mesh.corners.size());
+			for (uint32_t i = 0; i < soup.size(); ++i) soup[i] = i;
+			float acmr_soup = acmr(soup);
+			float acmr_indexed = acmr(local);
+
+			local = reorder_triangles(local, uint32_t(local_vertices.size()));
+
+			//renumber vertices in order of first use:
+			std::vector< uint32_t > remap(local_vertices.size(), -1U);
+			IndexedEntry entry;
+			entry.vertex_begin = uint32_t(out_vertices.size());
+			entry.element_begin = uint32_t(out_elements.size());
+			for (uint32_t i : local) {
+				if (remap[i] == -1U) {
+					remap[i] = uint32_t(out_vertices.size());
+					out_vertices.emplace_back(local_vertices[i]);
+				}
+				out_elements.emplace_back(remap[i]);
+			}
+			entry.vertex_end = uint32_t(out_vertices.size());
+			entry.element_end = uint32_t(out_elements.size());
+			entry.name_begin = uint32_t(out_strings.size());
+			out_strings.insert(out_strings.end(), mesh.name.begin(), mesh.name.end());
+			entry.name_end = uint32_t(out_strings.size());
+			out_index.emplace_back(entry);
+
+			std::vector< uint32_t > optimized(out_elements.begin() + entry.element_begin, out_elements.end());
+			float acmr_optimized = acmr(optimized);
+
+			std::cout << "  '" << mesh.name << "': " << mesh.corners.size() << " -> " << (entry.vertex_end - entry.vertex_begin)
+				<< ", " << acmr_soup << " -> " << acmr_indexed << " -> " << acmr_optimized;
+			if (degenerate) std::cout << " (dropped " << degenerate << " degenerate triangles)";
+			std::cout << "\n";
+
+			total_before += mesh.corners.size();
+			total_after += entry.vertex_end - entry.vertex_begin;
+			total_misses_before += acmr_soup * (mesh.corners.size() / 3);
+			total_misses_after += acmr_optimized * (optimized.size() / 3);
+			total_triangles += mesh.corners.size() / 3;
+		}
+		std::cout << "total: " << total_before << " -> " << total_after << " vertices ("
+			<< (total_before * sizeof(Vertex)) << " -> " << (total_after * sizeof(Vertex) + out_elements.size() * sizeof(uint32_t)) << " bytes with indices)";
+		if (total_triangles) {
+			std::cout << ", ACMR " << (total_misses_before / total_triangles) << " -> " << (total_misses_after / total_triangles);
+		}
+		std::cout << std::endl;
+
+		ChunkWriter writer;
+		if (quantize) {
+			std::vector< PackedVertex > packed(out_vertices.size());
+			std::vector< Bounds > bounds(out_index.size());
+			size_t packed_bytes = packed.size() * sizeof(PackedVertex);
+			std::cout << "quantized to " << packed_bytes << " bytes ("
+				<< (100.0 * packed_bytes / (out_vertices.size() * sizeof(Vertex))) << "% of vertex data);"
+				<< " largest errors: position (as fraction of bounding box diagonal), normal (degrees), texcoord\n";
+			for (uint32_t m = 0; m < out_index.size(); ++m) {
+				IndexedEntry const &entry = out_index[m];
+				Bounds &b = bounds[m];
+				b.min = glm::vec3(entry.vertex_begin < entry.vertex_end ? std::numeric_limits< float >::infinity() : 0.0f);
+				b.max = glm::vec3(entry.vertex_begin < entry.vertex_end ?-std::numeric_limits< float >::infinity() : 0.0f);
+				for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+					b.min = glm::min(b.min, out_vertices[v].Position);
+					b.max = glm::max(b.max, out_vertices[v].Position);
+				}
+				glm::vec3 size = b.max - b.min;
+
+				float position_error = 0.0f, normal_error = 0.0f, texcoord_error = 0.0f;
+				for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+					Vertex const &in = out_vertices[v];
+					PackedVertex &out = packed[v];
+
+					//positions are stored as 16-bit fractions of the bounding box:
+					glm::vec3 decoded;
+					for (uint32_t c = 0; c < 3; ++c) {
+						float t = (size[c] > 0.0f ? (in.Position[c] - b.min[c]) / size[c] : 0.0f);
+						out.Position[c] = uint16_t(std::round(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f));
+						decoded[c] = b.min[c] + size[c] * (out.Position[c] / 65535.0f);
+					}
+					out.Position[3] = 0;
+					position_error = std::max(position_error, glm::length(decoded - in.Position));
+
+					//normals as 10-bit snorm (normalized first, since the shaders normalize anyway):
+					float len = glm::length(in.Normal);
+					glm::vec3 n = (len > 0.0f ? in.Normal / len : glm::vec3(0.0f));
+					out.Normal = glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f));
+					if (len > 0.0f) {
+						glm::vec3 d = glm::vec3(glm::unpackSnorm3x10_1x2(out.Normal));
+						float cosine = glm::dot(n, d) / glm::length(d);
+						normal_error = std::max(normal_error, glm::degrees(std::acos(std::min(std::max(cosine, -1.0f), 1.0f))));
+					}
+
+					out.Color = in.Color;
+
+					for (uint32_t c = 0; c < 2; ++c) {
+						out.TexCoord[c] = glm::packHalf1x16(in.TexCoord[c]);
+						texcoord_error = std::max(texcoord_error, std::abs(glm::unpackHalf1x16(out.TexCoord[c]) - in.TexCoord[c]));
+					}
+				}
+				float diagonal = glm::length(size);
+				std::string name(out_strings.data() + entry.name_begin, out_strings.data() + entry.name_end);
+				std::cout << "  '" << name << "': " << std::scientific << std::setprecision(2)
+					<< (diagonal > 0.0f ? position_error / diagonal : 0.0f) << ", " << normal_error << ", " << texcoord_error
+					<< std::fixed << std::setprecision(3) << "\n";
+			}
+			std::cout.flush();
+			writer.add("pnq0", packed);
+			writer.add("qnt0", bounds);
+		} else {
+			writer.add("pnct", out_vertices);
+		}
+		writer.add("str0", out_strings);
+		writer.add("idx1", out_index);
+		writer.add("elm0", out_elements);
+		std::ofstream out(out_filename, std::ios::binary);
+		writer.write(&out);
+		if (!out) {
+			throw std::runtime_error("Failed to write '" + out_filename + "'.");
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
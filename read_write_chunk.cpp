@@ -0,0 +1,119 @@
+#include "read_write_chunk.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+//compressed chunk data starts with this header, followed by per-block compressed sizes:
+struct CompressedHeader {
+	uint32_t size = 0; //uncompressed
+	uint32_t block_size = 0; //uncompressed
+};
+static_assert(sizeof(CompressedHeader) == 8, "CompressedHeader is packed");
+
+//decompressing blocks is only worth extra threads if there is enough data to go around:
+static constexpr size_t MinBytesPerThread = 4 << 20;
+
+size_t compressed_chunk_size(char const *data, size_t size) {
+	CompressedHeader header;
+	if (size < sizeof(header)) {
+		throw std::runtime_error("Compressed chunk is missing its header");
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (header.size != 0 && header.block_size == 0) {
+		throw std::runtime_error("Compressed chunk has zero block size");
+	}
+	size_t blocks = header.size ? (size_t(header.size) + header.block_size - 1) / header.block_size : 0;
+	if ((size - sizeof(header)) / 4 < blocks) {
+		throw std::runtime_error("Compressed chunk is missing block sizes");
+	}
+	return header.size;
+}
+
+void decompress_chunk(char const *data, size_t size, char *out) {
+	size_t total = compressed_chunk_size(data, size);
+	CompressedHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	size_t blocks = total ? (total + header.block_size - 1) / header.block_size : 0;
+
+	//find where each block starts:
+	std::vector< uint32_t > block_sizes(blocks);
+	if (blocks) std::memcpy(block_sizes.data(), data + sizeof(header), blocks * 4);
+	std::vector< size_t > block_offsets(blocks);
+	size_t offset = sizeof(header) + blocks * 4;
+	for (size_t b = 0; b < blocks; ++b) {
+		block_offsets[b] = offset;
+		if (size - offset < block_sizes[b]) {
+			throw std::runtime_error("Compressed chunk block out of range");
+		}
+		offset += block_sizes[b];
+	}
+
+	std::atomic< size_t > next_block(0);
+	std::atomic< bool > failed(false);
+	auto work = [&]() {
+		while (!failed) {
+			size_t b = next_block++;
+			if (b >= blocks) break;
+			size_t begin = b * header.block_size;
+			uLongf out_size = uLongf(std::min(total - begin, size_t(header.block_size)));
+			uLongf expected = out_size;
+			int ret = uncompress(
+				reinterpret_cast< Bytef * >(out + begin), &out_size,
+				reinterpret_cast< Bytef const * >(data + block_offsets[b]), uLong(block_sizes[b])
+			);
+			if (ret != Z_OK || out_size != expected) failed = true;
+		}
+	};
+
+	size_t threads = std::min< size_t >({
+		blocks,
+		std::max< size_t >(1, total / MinBytesPerThread),
+		std::max< size_t >(1, std::thread::hardware_concurrency())
+	});
+	std::vector< std::thread > helpers;
+	for (size_t t = 1; t < threads; ++t) {
+		helpers.emplace_back(work);
+	}
+	work(); //(this thread helps too)
+	for (auto &helper : helpers) {
+		helper.join();
+	}
+
+	if (failed) {
+		throw std::runtime_error("Failed to decompress chunk");
+	}
+}
+
+std::vector< char > compress_chunk(char const *data, size_t size, uint32_t block_size) {
+	assert(block_size > 0);
+	if (size > size_t(uint32_t(-1))) {
+		throw std::runtime_error("Chunk too large to compress");
+	}
+	CompressedHeader header;
+	header.size = uint32_t(size);
+	header.block_size = block_size;
+	size_t blocks = size ? (size + block_size - 1) / block_size : 0;
+
+	std::vector< char > out(sizeof(header) + blocks * 4);
+	std::memcpy(out.data(), &header, sizeof(header));
+
+	std::vector< Bytef > block(compressBound(block_size));
+	for (size_t b = 0; b < blocks; ++b) {
+		size_t begin = b * block_size;
+		uLongf block_out = uLongf(block.size());
+		int ret = compress2(block.data(), &block_out,
+			reinterpret_cast< Bytef const * >(data + begin), uLong(std::min(size - begin, size_t(block_size))),
+			Z_BEST_COMPRESSION
+		);
+		if (ret != Z_OK) {
+			throw std::runtime_error("Failed to compress chunk");
+		}
+		uint32_t block_out32 = uint32_t(block_out);
+		std::memcpy(out.data() + sizeof(header) + b * 4, &block_out32, 4);
+		out.insert(out.end(), block.begin(), block.begin() + block_out);
+	}
+	return out;
+}
@@ -4,12 +4,33 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <string>
+#include <utility>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
 // |ma|gi|c.|..| <-- four byte "magic number"
 // |sz|sz|sz|sz| <-- four byte (native endian) size
 // |TT...TT| * (sz/sizeof(TT)) <-- enough T structures to make up sz bytes
+//
+//If the high bit of the size is set, the chunk is compressed (read_chunk decompresses it transparently):
+// |rs|rs|rs|rs| <-- uncompressed size (must be a multiple of sizeof(TT))
+// |bs|bs|bs|bs| <-- uncompressed block size
+// |cs|cs|cs|cs| * ceil(rs/bs) <-- compressed size of each block
+// |zz...zz| * ceil(rs/bs) <-- blocks, each compressed as an independent zlib stream
+// (blocks are independent so that they can be decompressed in parallel)
+
+constexpr uint32_t ChunkCompressedBit = 0x80000000;
+
+//uncompressed size of compressed chunk data (throws if data is malformed):
+size_t compressed_chunk_size(char const *data, size_t size);
+//decompress chunk data into 'out' (which is compressed_chunk_size() bytes long); throws on failure:
+void decompress_chunk(char const *data, size_t size, char *out);
+//compress data into the format above:
+std::vector< char > compress_chunk(char const *data, size_t size, uint32_t block_size = 1 << 20);
 
 template< typename T >
 void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *to_) {
@@ -30,6 +51,20 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 		throw std::runtime_error("Unexpected magic number in chunk");
 	}
 
+	if (header.size & ChunkCompressedBit) {
+		std::vector< char > compressed(header.size & ~ChunkCompressedBit);
+		if (!from.read(compressed.data(), compressed.size())) {
+			throw std::runtime_error("Failed to read chunk data.");
+		}
+		size_t size = compressed_chunk_size(compressed.data(), compressed.size());
+		if (size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		to.resize(size / sizeof(T));
+		decompress_chunk(compressed.data(), compressed.size(), reinterpret_cast< char * >(to.data()));
+		return;
+	}
+
 	if (header.size % sizeof(T) != 0) {
 		throw std::runtime_error("Size of chunk not divisible by element size");
 	}
@@ -41,6 +76,98 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 }
 
 
+//in-memory version of read_chunk, for use with (e.g.) MappedFile:
+// instead of copying chunk data, returns a ChunkSpan that points into the memory.
+
+//position within a block of memory holding chunks:
+struct ChunkCursor {
+	ChunkCursor(char const *begin_, char const *end_) : at(begin_), end(end_) { }
+	char const *at;
+	char const *end;
+	bool done() const { return at == end; }
+};
+
+//view of the TT structures in a chunk:
+template< typename T >
+struct ChunkSpan {
+	T const *first = nullptr;
+	T const *last = nullptr;
+	T const *begin() const { return first; }
+	T const *end() const { return last; }
+	T const *data() const { return first; }
+	size_t size() const { return last - first; }
+	bool empty() const { return first == last; }
+	T const &operator[](size_t i) const { return first[i]; }
+
+	//if chunk data is compressed or isn't aligned well enough to point at directly, it gets copied here:
+	std::vector< T > copy;
+
+	ChunkSpan() = default;
+	ChunkSpan(ChunkSpan &&) = default; //(moving 'copy' keeps first/last valid)
+	ChunkSpan &operator=(ChunkSpan &&) = default;
+	ChunkSpan(ChunkSpan const &) = delete;
+	ChunkSpan &operator=(ChunkSpan const &) = delete;
+};
+
+template< typename T >
+void read_chunk(ChunkCursor *from_, std::string const &magic, ChunkSpan< T > *to_) {
+	static_assert(std::is_trivially_copyable< T >::value, "chunk elements are viewed in place");
+	assert(from_);
+	auto &from = *from_;
+	assert(to_);
+	auto &to = *to_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (size_t(from.end - from.at) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, from.at, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	uint32_t stored = header.size & ~ChunkCompressedBit;
+	if (size_t(from.end - from.at) - sizeof(header) < stored) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+	char const *data = from.at + sizeof(header);
+	from.at = data + stored;
+
+	if (header.size & ChunkCompressedBit) {
+		size_t size = compressed_chunk_size(data, stored);
+		if (size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		to.copy.resize(size / sizeof(T));
+		decompress_chunk(data, stored, reinterpret_cast< char * >(to.copy.data()));
+		to.first = to.copy.data();
+		to.last = to.first + to.copy.size();
+		return;
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	size_t count = header.size / sizeof(T);
+
+	if (reinterpret_cast< uintptr_t >(data) % alignof(T) == 0) {
+		to.copy.clear();
+		to.first = reinterpret_cast< T const * >(data);
+	} else {
+		//(e.g., a chunk following a string chunk whose length isn't a multiple of four)
+		to.copy.resize(count);
+		if (count) std::memcpy(to.copy.data(), data, header.size);
+		to.first = to.copy.data();
+	}
+	to.last = to.first + count;
+}
+
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
 void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
@@ -63,3 +190,173 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+//helper function to write a compressed chunk that read_chunk can read:
+template< typename T >
+void write_compressed_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_, uint32_t block_size = 1 << 20) {
+	assert(magic.size() == 4);
+	assert(to_);
+	auto &to = *to_;
+
+	std::vector< char > compressed = compress_chunk(reinterpret_cast< char const * >(from.data()), from.size() * sizeof(T), block_size);
+	if (compressed.size() >= ChunkCompressedBit) {
+		throw std::runtime_error("Compressed chunk too large");
+	}
+
+	to.write(magic.data(), 4);
+	uint32_t size = uint32_t(compressed.size()) | ChunkCompressedBit;
+	to.write(reinterpret_cast< const char * >(&size), 4);
+	to.write(compressed.data(), compressed.size());
+}
+
+
+//------------------------------------------------
+//Random access to chunks:
+// a ChunkTable indexes every chunk header in a block of memory (e.g., a MappedFile)
+// so chunks can be looked up by magic in any order; chunks nobody asks for are skipped.
+// (with a mapped file, skipped chunks are never even paged in)
+//
+//If the first chunk is a table of contents, its entries are used instead of walking the headers:
+// |to|c0|..|..| <-- "toc0"
+// |sz|sz|sz|sz|
+// |ma|gi|c.|..|of|of|of|of|sz|sz|sz|sz| * (sz/12) <-- magic, offset of chunk header from start, data size
+
+struct ChunkTable {
+	ChunkTable(char const *begin, char const *end);
+
+	struct Entry {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t offset = 0; //of chunk header, from 'begin'
+		uint32_t size = 0; //of (stored) chunk data, without ChunkCompressedBit
+	};
+	static_assert(sizeof(Entry) == 12, "TOC entry is packed");
+	std::vector< Entry > entries; //in file order
+
+	char const *begin;
+	char const *end;
+
+	//first chunk with a given magic (or nullptr if there is none):
+	Entry const *find(std::string const &magic) const;
+
+	//view of first chunk with a given magic; throws if there isn't one:
+	template< typename T >
+	void read(std::string const &magic, ChunkSpan< T > *to) const;
+};
+
+inline ChunkTable::ChunkTable(char const *begin_, char const *end_) : begin(begin_), end(end_) {
+	assert(begin <= end);
+	size_t total = end - begin;
+	if (total > size_t(uint32_t(-1))) {
+		throw std::runtime_error("Chunk file too large to index");
+	}
+
+	if (total >= 8 && std::memcmp(begin, "toc0", 4) == 0) {
+		ChunkCursor cursor(begin, end);
+		ChunkSpan< Entry > toc;
+		read_chunk(&cursor, "toc0", &toc);
+		entries.assign(toc.begin(), toc.end());
+		for (auto &entry : entries) {
+			entry.size &= ~ChunkCompressedBit;
+			//(chunk headers themselves are checked when the chunk is read)
+			if (entry.offset > total || total - entry.offset < 8 || total - entry.offset - 8 < entry.size) {
+				throw std::runtime_error("Table of contents entry out of range");
+			}
+		}
+	} else {
+		//no table of contents, so walk chunk headers:
+		size_t at = 0;
+		while (at < total) {
+			Entry entry;
+			if (total - at < 8) {
+				throw std::runtime_error("Failed to read chunk header");
+			}
+			std::memcpy(entry.magic, begin + at, 4);
+			std::memcpy(&entry.size, begin + at + 4, 4);
+			entry.size &= ~ChunkCompressedBit;
+			if (total - at - 8 < entry.size) {
+				throw std::runtime_error("Failed to read chunk data.");
+			}
+			entry.offset = uint32_t(at);
+			entries.emplace_back(entry);
+			at += 8 + size_t(entry.size);
+		}
+	}
+}
+
+inline ChunkTable::Entry const *ChunkTable::find(std::string const &magic) const {
+	if (magic.size() != 4) return nullptr;
+	for (auto const &entry : entries) {
+		if (std::memcmp(entry.magic, magic.data(), 4) == 0) return &entry;
+	}
+	return nullptr;
+}
+
+template< typename T >
+void ChunkTable::read(std::string const &magic, ChunkSpan< T > *to) const {
+	Entry const *entry = find(magic);
+	if (!entry) {
+		throw std::runtime_error("Missing '" + magic + "' chunk");
+	}
+	ChunkCursor cursor(begin + entry->offset, end);
+	read_chunk(&cursor, magic, to);
+	if (size_t(cursor.at - (begin + entry->offset)) != 8 + size_t(entry->size)) {
+		throw std::runtime_error("Table of contents entry for '" + magic + "' doesn't match chunk");
+	}
+}
+
+//helper that collects chunks and writes them (optionally preceded by a "toc0" table of contents):
+struct ChunkWriter {
+	template< typename T >
+	void add(std::string const &magic, std::vector< T > const &from, bool compress = false) {
+		assert(magic.size() == 4);
+		Chunk chunk;
+		chunk.magic = magic;
+		chunk.compressed = compress;
+		if (compress) {
+			chunk.data = compress_chunk(reinterpret_cast< char const * >(from.data()), from.size() * sizeof(T));
+			if (chunk.data.size() >= ChunkCompressedBit) {
+				throw std::runtime_error("Compressed chunk too large");
+			}
+		} else {
+			chunk.data.assign(
+				reinterpret_cast< char const * >(from.data()),
+				reinterpret_cast< char const * >(from.data() + from.size())
+			);
+		}
+		chunks.emplace_back(std::move(chunk));
+	}
+
+	void write(std::ostream *to, bool toc = true) const {
+		assert(to);
+		if (toc) {
+			std::vector< ChunkTable::Entry > entries;
+			entries.reserve(chunks.size());
+			size_t offset = 8 + 12 * chunks.size(); //(chunks start after the toc0 chunk)
+			for (auto const &chunk : chunks) {
+				ChunkTable::Entry entry;
+				std::memcpy(entry.magic, chunk.magic.data(), 4);
+				entry.offset = uint32_t(offset);
+				entry.size = uint32_t(chunk.data.size());
+				entries.emplace_back(entry);
+				offset += 8 + chunk.data.size();
+			}
+			if (offset > size_t(uint32_t(-1))) {
+				throw std::runtime_error("Chunk file too large for table of contents");
+			}
+			write_chunk("toc0", entries, to);
+		}
+		for (auto const &chunk : chunks) {
+			to->write(chunk.magic.data(), 4);
+			uint32_t size = uint32_t(chunk.data.size()) | (chunk.compressed ? ChunkCompressedBit : 0);
+			to->write(reinterpret_cast< const char * >(&size), 4);
+			to->write(chunk.data.data(), chunk.data.size());
+		}
+	}
+
+	struct Chunk {
+		std::string magic;
+		bool compressed = false;
+		std::vector< char > data; //as stored (i.e., compressed if 'compressed')
+	};
+	std::vector< Chunk > chunks;
+};
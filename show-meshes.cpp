@@ -2,6 +2,7 @@
 #include "ShowMeshesMode.hpp"
 #include "Load.hpp"
 #include "GL.hpp"
+#include "DrawLines.hpp"
 #include "load_save_png.hpp"
 
 #include <SDL.h>
@@ -170,7 +171,7 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			DrawLines::begin_frame();
 			Mode::current->draw(drawable_size);
 		}
 
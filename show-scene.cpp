@@ -2,6 +2,7 @@
 #include "ShowSceneMode.hpp"
 #include "Load.hpp"
 #include "GL.hpp"
+#include "DrawLines.hpp"
 #include "load_save_png.hpp"
 #include "ShowSceneProgram.hpp"
 
@@ -81,13 +82,16 @@ int main(int argc, char **argv) {
 
 	//------------ create game mode + make current --------------
 	bool usage = false;
+	//'--static' marks every drawable static, so they are drawn from static batches:
+	bool batch = (argc >= 2 && std::string(argv[1]) == "--static");
+	int arg = (batch ? 2 : 1);
 	std::string scene_file;
 	std::string meshes_file;
-	if (argc == 2) {
-		scene_file = argv[1];
-	} else if (argc == 3) {
-		scene_file = argv[1];
-		meshes_file = argv[2];
+	if (argc == arg + 1) {
+		scene_file = argv[arg];
+	} else if (argc == arg + 2) {
+		scene_file = argv[arg];
+		meshes_file = argv[arg + 1];
 	} else {
 		usage = true;
 	}
@@ -107,7 +111,7 @@ int main(int argc, char **argv) {
 	if (scene_file != "") {
 		try {
 			scene = new Scene();
-			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
+			scene->load(scene_file, [&buffer,&buffer_vao,&batch](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 				if (!buffer_vao) return;
 				Mesh const &mesh = buffer->lookup(mesh_name);
 
@@ -120,7 +124,13 @@ int main(int argc, char **argv) {
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
+				drawable.pipeline.position_to_object = mesh.position_to_object;
+				drawable.min = mesh.min;
+				drawable.max = mesh.max;
 
+				drawable.mesh_buffer = buffer;
+				drawable.is_static = batch;
 			});
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading scene '" << scene_file << "': " << e.what() << std::endl;
@@ -132,9 +142,14 @@ int main(int argc, char **argv) {
 		usage = true;
 	}
 	if (usage) {
-		std::cerr << "Usage:\n\t" << argv[0] << " <path/to/scene.scene> [path/to/meshes.pnct]" << std::endl;
+		std::cerr << "Usage:\n\t" << argv[0] << " [--static] <path/to/scene.scene> [path/to/meshes.pnct]" << std::endl;
 		return 1;
 	}
+	if (batch) {
+		scene->build_static_batches();
+		size_t batched = std::count_if(scene->drawables.begin(), scene->drawables.end(), [](Scene::Drawable const &d){ return d.batched; });
+		std::cout << "Merged " << batched << " of " << scene->drawables.size() << " drawables into " << scene->static_batches.size() << " static batches." << std::endl;
+	}
 	std::cout << "Showing scene from '" << scene_file << "' with";
 	if (meshes_file != "") {
 		std::cout << " meshes from '" << meshes_file << "'" << std::endl;
@@ -212,7 +227,7 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			DrawLines::begin_frame();
 			Mode::current->draw(drawable_size);
 		}
 